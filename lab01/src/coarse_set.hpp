@@ -14,16 +14,17 @@ struct CoarseSetNode {
 };
 
 /// A set implementation using a linked list with coarse grained locking.
+template <typename Monitor = NullMonitor<SetOperator>>
 class CoarseSet : public Set {
 private:
   // A03: You can add or remove fields as needed. Just having the `head`
   // pointer and the `lock` should be sufficient for task 3
   CoarseSetNode *head;
   std::mutex lock;
-  EventMonitor<CoarseSet, StdSet, SetOperator> *monitor;
+  Monitor *monitor;
 
 public:
-  CoarseSet(EventMonitor<CoarseSet, StdSet, SetOperator> *monitor)
+  CoarseSet(Monitor *monitor = Monitor::instance())
       : monitor(monitor) {
     // A03: Initiate the internal state
     this->head = new CoarseSetNode(INT_MIN,nullptr);
@@ -16,15 +16,16 @@ struct FineSetNode {
 };
 
 /// A set implementation using a linked list with fine grained locking.
+template <typename Monitor = NullMonitor<SetOperator>>
 class FineSet : public Set {
 private:
   FineSetNode *head;
 
-  EventMonitor<FineSet, StdSet, SetOperator> *monitor; ///< Event monitor
+  Monitor *monitor; ///< Event monitor
 
 public:
   /// Initiate the internal state
-  FineSet(EventMonitor<FineSet, StdSet, SetOperator> *monitor)
+  FineSet(Monitor *monitor = Monitor::instance())
       : monitor(monitor) {
     head = new FineSetNode(INT_MIN);
     head->next = nullptr;
@@ -11,6 +11,7 @@
 #define OPERATION_COUNT 2000
 #define DEFAULT_GENERATOR_SEED 0
 #define DEFAULT_OP_MOD 64
+#define DEFAULT_CHECKER_THREADS 4
 
 const std::vector<OpWeights<SetOperator>> DEFAULT_SET_GEN_WEIGHTS = {
     OpWeights<SetOperator>{op : SetOperator::Add, weight : 4},
@@ -19,70 +20,67 @@ const std::vector<OpWeights<SetOperator>> DEFAULT_SET_GEN_WEIGHTS = {
 };
 
 template <class CDS, typename Op>
-void worker_thread_func(CDS *data_structure, OpGenerator<Op> *generator, int thread_id)
+void worker_thread_func(CDS *data_structure, OpGenerator<Op> *generator, int thread_id, int thread_count)
 {
-    while (auto maybe_operation = generator->next())
+    OpStream<Op> stream = generator->stream(thread_id, thread_count);
+    while (auto maybe_operation = stream.next())
     {
-        SetOperation operation = maybe_operation.value();
+        Operation<Op> operation = maybe_operation.value();
         apply_op(data_structure, operation);
     }
 }
 
-template <class CDS, class DS, typename Op>
-void monitor_thread_func(EventMonitor<CDS, DS, Op> *monitor)
+template <class Monitor>
+void monitor_thread_func(Monitor *monitor)
 {
     monitor->monitor();
 }
 
-template <typename CDS, typename DS, typename Op>
+template <typename CDS, typename Monitor, typename Op>
 bool test_data_structure_n_threads(
     CDS *concurrent_data_structure,
     OpGenerator<Op> *generator,
-    EventMonitor<CDS, DS, Op> *monitor,
+    Monitor *monitor,
     int thread_count)
 {
-    // Setup threads
-    void *ptr = malloc(sizeof(std::thread) * thread_count);
-    memset(ptr, 0, sizeof(std::thread) * thread_count);
-    std::thread *workers = (std::thread *)ptr;
+    // Setup threads, every thread performs its own share of the operations
+    std::vector<std::thread> workers;
     for (int thread_id = 0; thread_id < thread_count; thread_id++)
     {
-        workers[thread_id] = std::thread(
+        workers.push_back(std::thread(
             worker_thread_func<CDS, Op>,
-            std::ref(concurrent_data_structure),
-            std::ref(generator),
-            std::ref(thread_id));
+            concurrent_data_structure,
+            generator,
+            thread_id,
+            thread_count));
     }
 
     // Start monitor thread
-    std::thread monitor_thread(monitor_thread_func<CDS, DS, Op>, std::ref(monitor));
+    std::thread monitor_thread(monitor_thread_func<Monitor>, std::ref(monitor));
 
     // Join threads
-    for (int i = 0; i < thread_count; i++)
+    for (std::thread &worker : workers)
     {
-        workers[i].join();
+        worker.join();
     }
 
     // Finish the monitor and monitor thread
     monitor->finish();
     monitor_thread.join();
 
-    // Cleanup
-    free(workers);
-
     return monitor->is_valid();
 }
 
 template <typename Set>
-bool test_set_n_threads(int thread_count, int op_arg_mod)
+bool test_set_n_threads(int thread_count, int op_arg_mod, int checker_threads = DEFAULT_CHECKER_THREADS)
 {
     StdSet test_set;
-    EventMonitor<Set, StdSet, SetOperator> monitor(&test_set);
+    SetMonitor monitor(&test_set, checker_threads);
     OpGenerator<SetOperator> generator(DEFAULT_SET_GEN_WEIGHTS, OPERATION_COUNT, op_arg_mod, DEFAULT_GENERATOR_SEED);
     Set set(&monitor);
     monitor.set_concurrent_data_structure(&set);
 
-    return test_data_structure_n_threads<Set, StdSet, SetOperator>(&set, &generator, &monitor, thread_count);
+    return test_data_structure_n_threads(&set, &generator, &monitor, thread_count);
 }
 
 int task_1()
@@ -192,11 +190,11 @@ int task_2()
     std::cout << "# Task 2: Simple Set" << std::endl;
 
     std::cout << "## Testing `SimpleSet` with 1 thread" << std::endl;
-    valid &= test_set_n_threads<SimpleSet>(1, DEFAULT_OP_MOD);
+    valid &= test_set_n_threads<SimpleSet<SetMonitor>>(1, DEFAULT_OP_MOD);
     std::cout << std::endl;
 
     std::cout << "## Testing `SimpleSet` with 8 threads" << std::endl;
-    valid &= test_set_n_threads<SimpleSet>(8, DEFAULT_OP_MOD);
+    valid &= test_set_n_threads<SimpleSet<SetMonitor>>(8, DEFAULT_OP_MOD);
     std::cout << std::endl;
 
     if (valid)
@@ -218,7 +216,7 @@ int task_3()
     for (int test_run = 0; test_run < 8; test_run++)
     {
         std::cout << "## Testing `CoarseSet` with 8 thread and seed: " << test_run << std::endl;
-        valid &= test_set_n_threads<CoarseSet>(8, DEFAULT_OP_MOD);
+        valid &= test_set_n_threads<CoarseSet<SetMonitor>>(8, DEFAULT_OP_MOD);
         std::cout << std::endl;
 
         if (!valid)
@@ -246,7 +244,7 @@ int task_4()
     for (int test_run = 0; test_run < 8; test_run++)
     {
         std::cout << "## Testing `FineSet` with 8 thread and seed: " << test_run << std::endl;
-        valid &= test_set_n_threads<FineSet>(8, DEFAULT_OP_MOD);
+        valid &= test_set_n_threads<FineSet<SetMonitor>>(8, DEFAULT_OP_MOD);
         std::cout << std::endl;
 
         if (!valid)
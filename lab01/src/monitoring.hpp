@@ -8,10 +8,20 @@
 #include <chrono>
 #include <thread>
 #include <atomic>
+#include <climits>
+#include <cstdint>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 #include "set.hpp"
 
-#define DEQUE_SLEEP_DELAY 50
+/// The number of queued events, after which a waiting monitor is woken up.
+#define MONITOR_BATCH_SIZE 64
 
 enum SetOperator {
     Add = 1,
@@ -63,6 +73,12 @@ bool apply_op(Set* set, Operation<SetOperator>& op) {
     }
 }
 
+/// Returns the key of the operation. Operations with different keys are
+/// independent, since every set operation only depends on its argument.
+int partition_key(Operation<SetOperator>& op) {
+    return op.argument;
+}
+
 /// A struct defining the weigh of an operator for the [`OpGenerator`] class.
 template<typename Op>
 struct OpWeights {
@@ -72,23 +88,34 @@ struct OpWeights {
     int weight;
 };
 
+/// The increment of SplitMix64, an odd approximation of 2^64 / phi.
+const uint64_t SPLITMIX_GAMMA = 0x9e3779b97f4a7c15;
+
+/// The output function of SplitMix64, which maps a counter to a random value.
+uint64_t splitmix64(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+}
+
+template<typename Op>
+class OpStream;
+
+/// Describes the operations of a test or benchmark run. The operations are
+/// generated by one [`OpStream`] per thread, see [`OpGenerator::stream`].
 template<typename Op>
 class OpGenerator {
     int target_op_count;
-    /// The amount of operations, which have been generated. This is an atomic
-    /// integer, to share the count across all threads.
-    std::atomic_int counter;
     /// The weight of the operators, that can be generated.
     std::vector<OpWeights<Op>> weights;
     /// The total weight used as a modulo during generation.
     int total_weight;
     /// A modulo applied to the number generated as the argument for the operations.
     int argument_modulo;
-    /// A lock around consecutive `rand()` calls, to make sure they
-    /// generate the same pair of values.
-    std::mutex rand_lock;
     int seed;
 
+    friend class OpStream<Op>;
+
 public:
     OpGenerator(
         std::vector<OpWeights<Op>> weights,
@@ -105,38 +132,116 @@ public:
         for (int i = 0; i < (int)this->weights.size(); i++) {
             total_weight += this->weights[i].weight;
         }
+    }
 
-        this->reset();
+    /// Returns the stream of the given thread. The operations are split
+    /// evenly between `thread_count` streams. A stream only depends on the
+    /// seed and the thread id, which makes every run reproducible.
+    OpStream<Op> stream(int thread_id, int thread_count = 1) {
+        int count = this->target_op_count / thread_count;
+        if (thread_id < this->target_op_count % thread_count) {
+            count += 1;
+        }
+        return OpStream<Op>(this, thread_id, count);
     }
+};
 
-    void reset() {
-        this->counter = 0;
-        srand(this->seed);
+/// The operations of a single thread. The stream uses a counter-based
+/// SplitMix64 generator: the n-th random value is computed from the stream
+/// key and n alone. Streams therefore don't share any state.
+template<typename Op>
+class OpStream {
+    OpGenerator<Op>* generator;
+    uint64_t key;
+    /// Every stream uses its own odd increment, to keep the streams apart.
+    uint64_t gamma;
+    uint64_t counter = 0;
+    int remaining;
+
+public:
+    OpStream(OpGenerator<Op>* generator, int stream_id, int count) :
+        generator(generator),
+        remaining(count)
+    {
+        uint64_t base = splitmix64((uint64_t)generator->seed);
+        this->key = splitmix64(base + (stream_id + 1) * SPLITMIX_GAMMA);
+        this->gamma = splitmix64(this->key) | 1;
     }
 
     std::optional<Operation<Op>> next() {
-        if (this->counter.fetch_add(1) >= target_op_count) {
+        if (this->remaining == 0) {
             return std::nullopt;
         }
+        this->remaining -= 1;
 
-        // Rand generation
-        this->rand_lock.lock();
-        int op_selection = rand() % this->total_weight;
-        int argument = rand() % argument_modulo;
-        this->rand_lock.unlock();
+        // The upper half selects the operator, the lower half the argument
+        uint64_t random = splitmix64(this->key + this->counter * this->gamma);
+        this->counter += 1;
+        int op_selection = (random >> 32) % this->generator->total_weight;
+        int argument = (uint32_t)random % this->generator->argument_modulo;
 
         // Select operator
         int weight_index = 0;
-        while (op_selection > this->weights[weight_index].weight) {
-            op_selection -= this->weights[weight_index].weight;
+        while (op_selection >= this->generator->weights[weight_index].weight) {
+            op_selection -= this->generator->weights[weight_index].weight;
             weight_index += 1;
         }
-        Op op = this->weights[weight_index].op;
+        Op op = this->generator->weights[weight_index].op;
 
         return Operation<Op>(op, argument);
     }
 };
 
+/// Blocks the calling thread as long as `*word == expected`. The function
+/// can return spuriously, callers should check their condition again.
+void futex_wait(std::atomic<uint32_t>* word, uint32_t expected) {
+#ifdef __linux__
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#else
+    word->wait(expected);
+#endif
+}
+
+/// Wakes all threads blocked in [`futex_wait`] on the given word.
+void futex_wake(std::atomic<uint32_t>* word) {
+#ifdef __linux__
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#else
+    word->notify_all();
+#endif
+}
+
+/// Allows a consumer thread to sleep until a producer has new work for it.
+/// Producers only pay for a wakeup, if the consumer is actually sleeping.
+///
+/// The consumer has to call `prepare()`, then check if there is any work
+/// and only then call `wait()`. This order ensures that no wakeup is lost.
+struct WakeSignal {
+    std::atomic<uint32_t> sequence = 0;
+    std::atomic<bool> sleeping = false;
+
+    uint32_t prepare() {
+        this->sleeping = true;
+        return this->sequence.load();
+    }
+
+    void wait(uint32_t sequence) {
+        futex_wait(&this->sequence, sequence);
+        this->sleeping = false;
+    }
+
+    void cancel() {
+        this->sleeping = false;
+    }
+
+    void notify() {
+        if (this->sleeping) {
+            this->sequence.fetch_add(1);
+            futex_wake(&this->sequence);
+        }
+    }
+};
+
 template<typename Op>
 struct Event {
     /// The operator that this event used.
@@ -194,29 +299,79 @@ bool test_events(DS* data_structure, std::queue<Event<Op>>* events, bool verbose
     return true;
 }
 
+/// A checker validates the events of one shard against its own copy of the
+/// sequential data structure. See [`EventMonitor::monitor`].
+template<typename DS, typename Op>
+struct EventChecker {
+    DS* data_structure;
+    /// The events dispatched to this checker, which haven't been validated yet.
+    std::queue<Event<Op>> events_to_test;
+    std::mutex lock;
+    std::thread thread;
+    /// Wakes the checker, once events have been dispatched to it.
+    WakeSignal signal;
+    /// The number of events validated by this checker.
+    uint64_t event_count = 0;
+};
+
 /// This class uses coarse grained locking, because this is the simplest thing
 /// to implement. During the course you'll learn about more efficient algorithms
 /// for concurrent data structures.
+///
+/// The validation can be distributed over several checker threads. Events
+/// with different [`partition_key`]s are independent, the monitor therefore
+/// assigns every key to one checker and only keeps the order of events with
+/// the same key. Every checker uses its own sequential data structure.
 template<typename CAS, typename DS, typename Op>
 class EventMonitor {
 public:
-    EventMonitor(DS* data_structure) :
-        data_structure(data_structure),
+    /// Data structures can skip any work, which is only done for the monitor,
+    /// if this is `false`. See [`NullMonitor`].
+    static constexpr bool enabled = true;
+
+    EventMonitor(DS* data_structure, int checker_threads = 1) :
         concurrent_data_structure(nullptr)
     {
+        for (int i = 0; i < checker_threads; i++) {
+            EventChecker<DS, Op>* checker = new EventChecker<DS, Op>();
+            checker->data_structure = (i == 0) ? data_structure : new DS();
+            this->checkers.push_back(checker);
+        }
+    }
+
+    ~EventMonitor() {
+        for (int i = 0; i < (int)this->checkers.size(); i++) {
+            if (i != 0) {
+                delete this->checkers[i]->data_structure;
+            }
+            delete this->checkers[i];
+        }
     }
 
     void add(Event<Op> event) {
         this->lock.lock(); // Linearization point (For anyone that is interested)
         this->events_to_test.push(event);
+        bool batch_ready = this->events_to_test.size() == MONITOR_BATCH_SIZE;
         this->lock.unlock();
+
+        if (batch_ready) {
+            this->signal.notify();
+        }
     }
 
     void finish() {
         this->stop = true;
+        this->signal.notify();
     }
 
     bool monitor() {
+        // With a single checker, the events are validated on this thread
+        if (this->checkers.size() > 1) {
+            for (EventChecker<DS, Op>* checker : this->checkers) {
+                checker->thread = std::thread(&EventMonitor::checker_thread_func, this, checker);
+            }
+        }
+
         bool running = true;
         while (running) {
             // `running` and `this->finish` are separate flags, to ensure that
@@ -231,27 +386,43 @@ public:
             this->lock.unlock();
 
             if (events_to_test.empty()) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(DEQUE_SLEEP_DELAY));
-            } else {
-                this->event_count += events_to_test.size();
-                this->valid &= test_events(this->data_structure, &events_to_test, false);
-
-                if (!this->valid) {
-                    if (this->concurrent_data_structure) {
-                        std::cout << "  - Concurrent State: ";
-                        this->concurrent_data_structure->print_state();
-                        std::cout << std::endl;
-                    }
-                    this->event_count -= events_to_test.size();
-                    break;
+                if (running) {
+                    this->wait_for_batch();
                 }
+            } else if (this->checkers.size() > 1) {
+                this->dispatch(&events_to_test);
+            } else {
+                this->valid = this->check(this->checkers[0], &events_to_test);
             }
+
+            if (!this->valid) {
+                break;
+            }
+        }
+
+        if (this->checkers.size() > 1) {
+            this->checkers_done = true;
+            for (EventChecker<DS, Op>* checker : this->checkers) {
+                checker->signal.notify();
+                checker->thread.join();
+            }
+        }
+
+        uint64_t event_count = 0;
+        for (EventChecker<DS, Op>* checker : this->checkers) {
+            event_count += checker->event_count;
+        }
+
+        if (!this->valid && this->concurrent_data_structure) {
+            std::cout << "  - Concurrent State: ";
+            this->concurrent_data_structure->print_state();
+            std::cout << std::endl;
         }
 
         if (this->valid) {
-            std::cout << "Successfully validated " << this->event_count << " events" << std::endl;
+            std::cout << "Successfully validated " << event_count << " events" << std::endl;
         } else {
-            std::cout << "Validation failed after " << this->event_count << " events" << std::endl;
+            std::cout << "Validation failed after " << event_count << " events" << std::endl;
         }
 
         return this->valid;
@@ -266,15 +437,117 @@ public:
     }
 
 private:
+    /// Sleeps until `MONITOR_BATCH_SIZE` events are queued or the monitor
+    /// is finished.
+    void wait_for_batch() {
+        uint32_t sequence = this->signal.prepare();
+        this->lock.lock();
+        bool ready = this->events_to_test.size() >= MONITOR_BATCH_SIZE;
+        this->lock.unlock();
+
+        if (ready || this->stop) {
+            this->signal.cancel();
+        } else {
+            this->signal.wait(sequence);
+        }
+    }
+
+    /// Distributes the given events to the checkers. Events with the same
+    /// key are always assigned to the same checker, in sequence order.
+    void dispatch(std::queue<Event<Op>>* events) {
+        int checker_count = this->checkers.size();
+        std::vector<std::queue<Event<Op>>> shards(checker_count);
+        while (!events->empty()) {
+            Event<Op>& event = events->front();
+            unsigned int key = partition_key(event.op);
+            shards[key % checker_count].push(event);
+            events->pop();
+        }
+
+        for (int i = 0; i < checker_count; i++) {
+            if (shards[i].empty()) {
+                continue;
+            }
+            EventChecker<DS, Op>* checker = this->checkers[i];
+            checker->lock.lock();
+            while (!shards[i].empty()) {
+                checker->events_to_test.push(shards[i].front());
+                shards[i].pop();
+            }
+            checker->lock.unlock();
+            checker->signal.notify();
+        }
+    }
+
+    /// Validates the given events with the data structure of the checker
+    bool check(EventChecker<DS, Op>* checker, std::queue<Event<Op>>* events) {
+        uint64_t size = events->size();
+        bool valid = test_events(checker->data_structure, events, false);
+        checker->event_count += size - events->size();
+        return valid;
+    }
+
+    void checker_thread_func(EventChecker<DS, Op>* checker) {
+        bool running = true;
+        while (running && this->valid) {
+            if (this->checkers_done) {
+                running = false;
+            }
+
+            uint32_t sequence = checker->signal.prepare();
+            std::queue<Event<Op>> events_to_test;
+            checker->lock.lock();
+            checker->events_to_test.swap(events_to_test);
+            checker->lock.unlock();
+
+            if (!events_to_test.empty() || this->checkers_done) {
+                checker->signal.cancel();
+            } else {
+                checker->signal.wait(sequence);
+            }
+
+            if (events_to_test.empty()) {
+                continue;
+            } else if (!this->check(checker, &events_to_test)) {
+                this->valid = false;
+            }
+        }
+    }
+
     std::queue<Event<Op>> events_to_test;
     std::mutex lock;
+    /// Wakes the monitor thread, once a batch of events is ready.
+    WakeSignal signal;
 
     // For monitoring and validation
-    DS* data_structure;
-    int event_count = 0;
-    bool stop = false;
-    bool valid = true;
+    std::vector<EventChecker<DS, Op>*> checkers;
+    std::atomic<bool> stop = false;
+    std::atomic<bool> checkers_done = false;
+    std::atomic<bool> valid = true;
 
     /// The concurrent data structure, to print the internal state:
     CAS* concurrent_data_structure;
 };
+
+/// A monitor policy, which discards all events. The data structures take their
+/// monitor as a template parameter, [`EventMonitor`] validates the events for
+/// tests, while this policy is used for benchmarks and production builds.
+/// All functions are empty and get inlined, no event is ever constructed.
+template<typename Op>
+class NullMonitor {
+public:
+    static constexpr bool enabled = false;
+
+    void add(Event<Op> event) {}
+
+    /// A shared instance for data structures, which are created without a monitor.
+    static NullMonitor* instance() {
+        static NullMonitor monitor;
+        return &monitor;
+    }
+};
+
+class StdSet;
+
+/// The validating monitor policy for sets.
+typedef EventMonitor<Set, StdSet, SetOperator> SetMonitor;
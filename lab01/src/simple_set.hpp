@@ -13,15 +13,16 @@ struct SimpleSetNode {
 
 /// A simple set implementation using a linked list. This class shouldn't have
 // any synchronization yet.
+template <typename Monitor = NullMonitor<SetOperator>>
 class SimpleSet : public Set {
 private:
   // A02: You can add or remove fields as needed. Just having the `head`
   // pointer should be sufficient for task 2
   SimpleSetNode *head;
-  EventMonitor<SimpleSet, StdSet, SetOperator> *monitor;
+  Monitor *monitor;
 
 public:
-  SimpleSet(EventMonitor<SimpleSet, StdSet, SetOperator> *monitor)
+  SimpleSet(Monitor *monitor = Monitor::instance())
       : monitor(monitor) {
     this->head = new SimpleSetNode(INT_MIN,nullptr);
   }
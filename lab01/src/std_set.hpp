@@ -2,36 +2,106 @@
 
 #include "set.hpp"
 
+#include <algorithm>
+#include <cstdint>
 #include <set>
+#include <vector>
 
+#ifndef DENSE_KEY_LIMIT
+/// Keys in `[0, DENSE_KEY_LIMIT)` are stored in dense arrays by the reference
+/// data structures. Other keys fall back to a tree.
+#define DENSE_KEY_LIMIT 65536
+#endif
+
+/// The sequential reference set. Small non-negative keys are stored in a
+/// bitmap, which grows with the largest key. All other keys are stored in
+/// a `std::set`.
 class StdSet: public Set {
    public:
     bool add(int elem) override {
-        return this->state.insert(elem).second;
+        if (!is_dense(elem)) {
+            return this->sparse.insert(elem).second;
+        }
+        if (elem / 64 >= (int)this->bits.size()) {
+            this->bits.resize(elem / 64 + 1, 0);
+        }
+        uint64_t& word = this->bits[elem / 64];
+        uint64_t mask = (uint64_t)1 << (elem % 64);
+        bool added = (word & mask) == 0;
+        word |= mask;
+        return added;
     }
 
     bool rmv(int elem) override {
-        return this->state.erase(elem);
+        if (!is_dense(elem)) {
+            return this->sparse.erase(elem);
+        }
+        if (!this->ctn(elem)) {
+            return false;
+        }
+        this->bits[elem / 64] &= ~((uint64_t)1 << (elem % 64));
+        return true;
     }
 
     bool ctn(int elem) override {
-        return this->state.find(elem) != this->state.end();
+        if (!is_dense(elem)) {
+            return this->sparse.find(elem) != this->sparse.end();
+        }
+        if (elem / 64 >= (int)this->bits.size()) {
+            return false;
+        }
+        return (this->bits[elem / 64] >> (elem % 64)) & 1;
+    }
+
+    bool operator==(const StdSet& other) const {
+        if (this->sparse != other.sparse) {
+            return false;
+        }
+        // The bitmaps only differ in size, if the missing words are empty
+        size_t size = std::max(this->bits.size(), other.bits.size());
+        for (size_t i = 0; i < size; i++) {
+            uint64_t word = i < this->bits.size() ? this->bits[i] : 0;
+            uint64_t other_word = i < other.bits.size() ? other.bits[i] : 0;
+            if (word != other_word) {
+                return false;
+            }
+        }
+        return true;
     }
 
     void print_state() override {
         std::cout << "{";
         bool first = true;
-        for (auto it = this->state.begin(); it != this->state.end(); it++) {
+        auto print_elem = [&](int elem) {
             if (first) {
                 first = false;
             } else {
                 std::cout << ", ";
             }
-            std::cout << *it;
+            std::cout << elem;
+        };
+
+        // Negative keys are stored in the tree, but come before the bitmap
+        auto it = this->sparse.begin();
+        for (; it != this->sparse.end() && *it < 0; it++) {
+            print_elem(*it);
+        }
+        for (int elem = 0; elem < (int)this->bits.size() * 64; elem++) {
+            if (this->ctn(elem)) {
+                print_elem(elem);
+            }
+        }
+        for (; it != this->sparse.end(); it++) {
+            print_elem(*it);
         }
         std::cout << "}";
     }
 
    private:
-    std::set<int> state;
+    static bool is_dense(int elem) {
+        return elem >= 0 && elem < DENSE_KEY_LIMIT;
+    }
+
+    std::vector<uint64_t> bits;
+    std::set<int> sparse;
 };
@@ -1,102 +1,921 @@
 #pragma once
 
 #include "monitoring.hpp"
+#include "test.hpp"
+#include "results.hpp"
+#include "instrument.hpp"
+#include "memory.hpp"
 #include "std_set.hpp"
 #include "set.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <map>
 #include <stdio.h>
-#include <sys/time.h>
-#include <time.h>
+#include <string>
 
 /// This namespace holds all functions required for benchmarking.
 namespace bench {
 
-    const int OP_COUNT = 500;
+    const int OP_COUNT = 1000;
     const int VALUE_MODS[] = {8, 1024};
     const int CTN_WEIGHTS[] = {10, 50, 90};
     const int THREAD_COUNTS[] = {1, 2, 4, 8, 16, 32};
     const int DEFAULT_GENERATOR_SEED = 0;
+    const int MONITOR_EVENT_COUNT = 100000;
+    const int MONITOR_THREAD_COUNTS[] = {1, 2, 4, 8};
+    const KeyDistribution KEY_DISTRIBUTIONS[] = {
+        KeyDistribution::uniform(),
+        KeyDistribution::zipfian(0.99),
+        KeyDistribution::hotspot(0.2, 0.8),
+        KeyDistribution::sequential(),
+        KeyDistribution::latest(0.99),
+    };
+    /// The sample rate of the sampled monitor in `benchmark_monitor_overhead`.
+    const int MONITOR_SAMPLE_RATE = 64;
+    /// The untimed runs of every configuration, before the repetitions.
+    const int WARMUP_RUNS = 1;
+    const int REPETITIONS = 5;
+    /// Configurations are marked unstable, if the standard deviation of the
+    /// throughput exceeds this fraction of the mean.
+    const double UNSTABLE_VARIATION = 0.1;
+    /// The 97.5% quantiles of Student's t-distribution for 1 to 30 degrees
+    /// of freedom, used for the 95% confidence interval of the mean.
+    const double T_QUANTILES[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+    };
 
+    /// Returns a monotonic timestamp in ms.
     double time_now() {
-        struct timeval t;
-        gettimeofday(&t, NULL);
-        return (t.tv_sec + t.tv_usec / 1000000.0) * 1000.0;
+        return std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count();
     }
 
     struct BenchConfig {
         int value_mod;
         int ctn_weight;
+        int add_weight;
+        int rmv_weight;
         int threads;
+        KeyDistribution distribution;
+        /// The number of operations performed by every thread.
+        int op_count = OP_COUNT;
+        /// The run time in ms of duration runs, where every thread repeats
+        /// its operations until the time is up. Zero performs `op_count`
+        /// operations per thread instead.
+        double duration = 0.0;
+        int seed = DEFAULT_GENERATOR_SEED;
+        /// The fraction of the keys, which are inserted before the
+        /// measurement starts.
+        double prefill = 0.0;
+        /// The operations offered per ms by all threads together. Zero runs
+        /// the closed-loop benchmark, where every thread issues the next
+        /// operation as soon as the previous one returned.
+        double rate = 0.0;
+        ArrivalProcess arrival = ArrivalFixed;
+        int warmup = WARMUP_RUNS;
+        int repetitions = REPETITIONS;
+        /// Records the latency of every operation in the timed runs. The
+        /// clock reads slightly lower the throughput.
+        bool latencies = false;
+        /// The placement of the worker threads of closed-loop runs.
+        PlacementPolicy placement = PlacementNone;
+        /// Counts hardware and software events in the timed runs, see
+        /// `PerfCounterGroup`.
+        bool counters = false;
+        /// Tracks the heap allocations in an extra untimed run, see
+        /// `MemoryTotals`.
+        bool memory = false;
 
-        BenchConfig(int value_mod, int ctn_weight, int threads) {
+        /// Creates a configuration, where 90% of the remaining operations
+        /// are adds and 10% are removes.
+        BenchConfig(int value_mod, int ctn_weight, int threads, KeyDistribution distribution = KeyDistribution::uniform()) {
             this->value_mod = value_mod;
             this->ctn_weight = ctn_weight;
+            this->add_weight = (100 - ctn_weight) * 0.9;
+            this->rmv_weight = 100 - ctn_weight - this->add_weight;
             this->threads = threads;
+            this->distribution = distribution;
         }
 
         int get_add_weight() {
-            return (100 - this->ctn_weight) * 0.9;
+            return this->add_weight;
         }
 
         int get_rmv_weight() {
-            return 100 - this->ctn_weight - this->get_add_weight();
+            return this->rmv_weight;
+        }
+
+        /// Returns the fraction of the keys in a set, once the operation mix
+        /// ran long enough. Every key is added and removed in the ratio of
+        /// the weights, regardless of the key distribution, so it's present
+        /// with a probability of `add / (add + rmv)`.
+        double steady_state_prefill() {
+            int updates = this->add_weight + this->rmv_weight;
+            if (updates == 0) {
+                return 0.0;
+            }
+            return (double)this->add_weight / updates;
+        }
+    };
+
+    /// The throughput of the repetitions of a configuration, in ops/ms.
+    struct RunStats {
+        int runs = 0;
+        double median = 0.0;
+        double mean = 0.0;
+        double stddev = 0.0;
+        /// The half width of the 95% confidence interval of the mean.
+        double ci = 0.0;
+
+        RunStats(std::vector<double> throughputs) {
+            this->runs = throughputs.size();
+            if (this->runs == 0) {
+                return;
+            }
+
+            std::sort(throughputs.begin(), throughputs.end());
+            int middle = this->runs / 2;
+            this->median = this->runs % 2 == 1
+                ? throughputs[middle]
+                : (throughputs[middle - 1] + throughputs[middle]) / 2.0;
+
+            for (double throughput : throughputs) {
+                this->mean += throughput / this->runs;
+            }
+            if (this->runs < 2) {
+                return;
+            }
+            double squares = 0.0;
+            for (double throughput : throughputs) {
+                squares += (throughput - this->mean) * (throughput - this->mean);
+            }
+            this->stddev = std::sqrt(squares / (this->runs - 1));
+
+            int degrees = this->runs - 1;
+            double quantile = degrees <= 30 ? T_QUANTILES[degrees - 1] : 1.96;
+            this->ci = quantile * this->stddev / std::sqrt(this->runs);
+        }
+
+        bool is_unstable() {
+            return this->stddev > UNSTABLE_VARIATION * this->mean;
         }
     };
 
     void print_table_header() {
-        printf("          name,  values, ctn [%%], add [%%], rmv [%%], threads, time [ms], total ops\n");
+        printf("          name,         keys,  values, ctn [%%], add [%%], rmv [%%], threads, placement, total ops, runs, median [ops/ms], mean [ops/ms], stddev, ci95 [ops/ms], stable\n");
     }
 
-    void print_table_row(char const* ds_name, BenchConfig& config, double time) {
+    void print_table_row(char const* ds_name, BenchConfig& config, RunStats& stats) {
         printf(
-            "%14s, 0..%-4d,     %3d,     %3d,     %3d,      %2d, %9.4f,    %6d\n",
+            "%14s, %12s, 0..%-4d,     %3d,     %3d,     %3d,      %2d, %9s,  %8d,   %2d, %15.1f, %13.1f, %6.1f, %13.1f, %6s\n",
             ds_name,
+            config.distribution.name().c_str(),
             config.value_mod,
             config.ctn_weight,
             config.get_add_weight(),
             config.get_rmv_weight(),
             config.threads,
+            placement_name(config.placement),
+            config.threads * config.op_count,
+            stats.runs,
+            stats.median,
+            stats.mean,
+            stats.stddev,
+            stats.ci,
+            stats.is_unstable() ? "no" : "yes"
+        );
+    }
+
+    void print_duration_header() {
+        printf("          name,         keys,  values, ctn [%%], add [%%], rmv [%%], threads, placement, prefill, time [ms], runs, total [ops/s], per thread [ops/s], min thread [ops/s], max thread [ops/s], ci95 [ops/s], stable\n");
+    }
+
+    /// Prints the throughput of a duration run in ops/s. `stats` holds the
+    /// total throughput in ops/ms, `thread_throughputs` the throughput of
+    /// every thread of every timed run.
+    void print_duration_row(char const* ds_name, BenchConfig& config, RunStats& stats, std::vector<double>& thread_throughputs) {
+        double min_thread = 0.0;
+        double max_thread = 0.0;
+        if (!thread_throughputs.empty()) {
+            min_thread = *std::min_element(thread_throughputs.begin(), thread_throughputs.end());
+            max_thread = *std::max_element(thread_throughputs.begin(), thread_throughputs.end());
+        }
+
+        printf(
+            "%14s, %12s, 0..%-4d,     %3d,     %3d,     %3d,      %2d, %9s,   %4.0f%%, %9.0f,   %2d, %13.0f, %18.0f, %18.0f, %18.0f, %12.0f, %6s\n",
+            ds_name,
+            config.distribution.name().c_str(),
+            config.value_mod,
+            config.ctn_weight,
+            config.get_add_weight(),
+            config.get_rmv_weight(),
+            config.threads,
+            placement_name(config.placement),
+            config.prefill * 100.0,
+            config.duration,
+            stats.runs,
+            stats.median * 1000.0,
+            stats.median * 1000.0 / config.threads,
+            min_thread * 1000.0,
+            max_thread * 1000.0,
+            stats.ci * 1000.0,
+            stats.is_unstable() ? "no" : "yes"
+        );
+    }
+
+    /// Appends the results of a configuration to the results file of this
+    /// process. The file is `BENCH_RESULTS` or `DEFAULT_RESULTS_FILE`.
+    void record_result(char const* ds_name, BenchConfig& config, RunStats& stats) {
+        const char* path = getenv("BENCH_RESULTS");
+        static ResultWriter writer(path ? path : DEFAULT_RESULTS_FILE);
+
+        // The CPUs are separated by spaces, to keep a single column
+        std::string cpus;
+        for (int cpu : placement_cpus(config.placement, config.threads)) {
+            cpus += (cpus.empty() ? "" : " ") + std::to_string(cpu);
+        }
+
+        char row[512];
+        snprintf(
+            row,
+            sizeof(row),
+            "%s,%s,%d,%d,%d,%d,%d,%d,%g,%g,%d,%s,%d,%.3f,%.3f,%.3f,%.3f,%s",
+            ds_name,
+            config.distribution.name().c_str(),
+            config.value_mod,
+            config.ctn_weight,
+            config.add_weight,
+            config.rmv_weight,
+            config.threads,
+            config.op_count,
+            config.duration,
+            config.prefill,
+            config.seed,
+            placement_name(config.placement),
+            stats.runs,
+            stats.median,
+            stats.mean,
+            stats.stddev,
+            stats.ci,
+            cpus.c_str()
+        );
+        writer.append(row);
+    }
+
+    /// Prints the latency percentiles of every operator below a table row.
+    template <typename Op>
+    void print_latency_rows(OpHistograms<Op>& latencies) {
+        printf("                    op,    count, p50 [us], p90 [us], p99 [us], p99.9 [us], max [us]\n");
+        for (size_t op = 0; op < latencies.histograms.size(); op++) {
+            LatencyHistogram& histogram = latencies.histograms[op];
+            if (histogram.count() == 0) {
+                continue;
+            }
+            printf(
+                "                  %4s, %8lu, %8.2f, %8.2f, %8.2f, %10.2f, %8.2f\n",
+                operator_name((Op)op),
+                histogram.count(),
+                histogram.percentile(0.5) / 1000.0,
+                histogram.percentile(0.9) / 1000.0,
+                histogram.percentile(0.99) / 1000.0,
+                histogram.percentile(0.999) / 1000.0,
+                histogram.max() / 1000.0
+            );
+        }
+    }
+
+    /// Prints the counted events per operation below a table row. Events,
+    /// which couldn't be counted on every thread, are printed as `n/a`.
+    void print_counter_rows(CounterTotals& counters) {
+        auto per_op = [&](CounterIndex index) {
+            char text[16] = "n/a";
+            if (counters.is_available(index)) {
+                snprintf(text, sizeof(text), "%.3f", counters.per_op(index));
+            }
+            return std::string(text);
+        };
+        std::string ipc = "n/a";
+        if (counters.is_available(CounterCycles) && counters.is_available(CounterInstructions)) {
+            char text[16];
+            snprintf(text, sizeof(text), "%.3f", counters.values[CounterInstructions] / counters.values[CounterCycles]);
+            ipc = text;
+        }
+
+        printf("              counters, cycles/op, instr/op,   IPC, L1d miss/op, LLC miss/op, br miss/op, ctx sw/op\n");
+        printf(
+            "                      , %9s, %8s, %5s, %11s, %11s, %10s, %9s\n",
+            per_op(CounterCycles).c_str(),
+            per_op(CounterInstructions).c_str(),
+            ipc.c_str(),
+            per_op(CounterL1dMisses).c_str(),
+            per_op(CounterLlcMisses).c_str(),
+            per_op(CounterBranchMisses).c_str(),
+            per_op(CounterContextSwitches).c_str()
+        );
+    }
+
+    /// Prints the contention counters below a table row. Lock wait and hold
+    /// times are per acquisition.
+    void print_contention_rows(ContentionTotals& contention) {
+        printf("            contention, cas fail/op, snip fail/op, retries/op, validate fail/op, locks/op, contended [%%], wait [ns], hold [ns]\n");
+        printf(
+            "                      , %11.4f, %12.4f, %10.4f, %16.4f, %8.2f, %13.1f, %9.1f, %9.1f\n",
+            contention.per_op(ContentionCasFailures),
+            contention.per_op(ContentionSnipFailures),
+            contention.per_op(ContentionLocateRetries),
+            contention.per_op(ContentionValidateFailures),
+            contention.per_op(ContentionLockAcquisitions),
+            contention.per_lock(ContentionLockContended) * 100.0,
+            contention.per_lock(ContentionLockWaitNs),
+            contention.per_lock(ContentionLockHoldNs)
+        );
+    }
+
+    /// Prints the memory use of the separate untimed run of
+    /// `measure_memory` below a table row. The bytes per element include
+    /// the sentinels and the garbage, which isn't freed until the structure
+    /// is destroyed.
+    void print_memory_rows(MemoryTotals& memory) {
+        int runs = std::max(memory.runs, 1);
+        char per_element[16] = "n/a";
+        if (memory.elements > 0) {
+            snprintf(per_element, sizeof(per_element), "%.1f", (double)memory.live / memory.elements);
+        }
+        char peak_rss[16] = "n/a";
+        if (memory.peak_rss_kib >= 0) {
+            snprintf(peak_rss, sizeof(peak_rss), "%.1f", memory.peak_rss_kib / 1024.0);
+        }
+
+        printf("                memory, live [KiB], peak [KiB], allocs/op, bytes/elem, leaked [KiB], peak RSS [MiB]\n");
+        printf(
+            "                      , %10.1f, %10.1f, %9.3f, %10s, %12.1f, %14s\n",
+            memory.live / 1024.0 / runs,
+            memory.peak / 1024.0 / runs,
+            memory.ops == 0 ? 0.0 : (double)memory.allocations / memory.ops,
+            per_element,
+            memory.leaked / 1024.0 / runs,
+            peak_rss
+        );
+    }
+
+    /// Prints the cycles per operation of every phase below a table row,
+    /// and their share of the cycles of all phases.
+    void print_phase_rows(ContentionTotals& contention) {
+        uint64_t total = 0;
+        for (uint64_t cycles : contention.phase_cycles) {
+            total += cycles;
+        }
+
+        printf("                phases");
+        for (int phase = 0; phase < OPERATION_PHASE_COUNT; phase++) {
+            printf(", %13s", phase_name((OperationPhase)phase));
+        }
+        printf(",     total\n");
+        printf("             cycles/op");
+        for (uint64_t cycles : contention.phase_cycles) {
+            printf(", %13.1f", contention.ops == 0 ? 0.0 : (double)cycles / contention.ops);
+        }
+        printf(", %9.1f\n", contention.ops == 0 ? 0.0 : (double)total / contention.ops);
+        printf("             share [%%]");
+        for (uint64_t cycles : contention.phase_cycles) {
+            printf(", %13.1f", total == 0 ? 0.0 : cycles * 100.0 / total);
+        }
+        printf(", %9.1f\n", total == 0 ? 0.0 : 100.0);
+    }
+
+    void print_open_loop_header() {
+        printf("          name,         keys,  values, ctn [%%], add [%%], rmv [%%], threads, arrival, offered [ops/ms], achieved [ops/ms], p50 [us], p99 [us], p99.9 [us], max [us]\n");
+    }
+
+    /// Prints the latency percentiles of an open-loop run. `latencies` are
+    /// in nanoseconds and get sorted.
+    void print_open_loop_row(char const* ds_name, BenchConfig& config, double time, std::vector<uint64_t>& latencies) {
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&](double p) {
+            if (latencies.empty()) {
+                return 0.0;
+            }
+            size_t index = std::min(latencies.size() - 1, (size_t)(p * latencies.size()));
+            return latencies[index] / 1000.0;
+        };
+
+        printf(
+            "%14s, %12s, 0..%-4d,     %3d,     %3d,     %3d,      %2d, %7s, %16.1f, %17.1f, %8.1f, %8.1f, %10.1f, %8.1f\n",
+            ds_name,
+            config.distribution.name().c_str(),
+            config.value_mod,
+            config.ctn_weight,
+            config.get_add_weight(),
+            config.get_rmv_weight(),
+            config.threads,
+            config.arrival == ArrivalPoisson ? "poisson" : "fixed",
+            config.rate,
+            time > 0.0 ? latencies.size() / time : 0.0,
+            percentile(0.5),
+            percentile(0.99),
+            percentile(0.999),
+            percentile(1.0)
+        );
+    }
+
+    void print_replay_header() {
+        printf("          name,  records, threads,  replay, time [ms],  ops/ms, p50 [us], p99 [us], max [us]\n");
+    }
+
+    /// Prints the results of a trace replay. `latencies` are in nanoseconds
+    /// and get sorted.
+    void print_replay_row(char const* ds_name, int threads, ReplayMode mode, double time, std::vector<uint64_t>& latencies) {
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&](double p) {
+            if (latencies.empty()) {
+                return 0.0;
+            }
+            size_t index = std::min(latencies.size() - 1, (size_t)(p * latencies.size()));
+            return latencies[index] / 1000.0;
+        };
+
+        printf(
+            "%14s, %8zu,      %2d, %7s, %9.4f, %7.1f, %8.1f, %8.1f, %8.1f\n",
+            ds_name,
+            latencies.size(),
+            threads,
+            mode == ReplayTimed ? "timed" : "ordered",
             time,
-            config.threads * OP_COUNT
+            latencies.size() / time,
+            percentile(0.5),
+            percentile(0.99),
+            percentile(1.0)
         );
     }
 
-    template <class Set>
-    void run_config(char const* set_name, BenchConfig& config) {
-        std::vector<OpWeights<SetOperator>> op_weights = {
-            OpWeights<SetOperator> {op: SetOperator::Add, weight: config.ctn_weight},
-            OpWeights<SetOperator> {op: SetOperator::Remove, weight: config.get_add_weight()},
-            OpWeights<SetOperator> {op: SetOperator::Contains, weight: config.get_rmv_weight()},
+    std::vector<OpWeights<SetOperator>> op_weights(BenchConfig& config, SetOperator) {
+        return {
+            OpWeights<SetOperator> {op: SetOperator::Add, weight: config.get_add_weight()},
+            OpWeights<SetOperator> {op: SetOperator::Remove, weight: config.get_rmv_weight()},
+            OpWeights<SetOperator> {op: SetOperator::Contains, weight: config.ctn_weight},
+        };
+    }
+
+    /// Maps the configuration to multiset operators, like for sets.
+    std::vector<OpWeights<MultisetOperator>> op_weights(BenchConfig& config, MultisetOperator) {
+        return {
+            OpWeights<MultisetOperator> {op: MultisetOperator::MSetAdd, weight: config.get_add_weight()},
+            OpWeights<MultisetOperator> {op: MultisetOperator::MSetRemove, weight: config.get_rmv_weight()},
+            OpWeights<MultisetOperator> {op: MultisetOperator::MSetCount, weight: config.ctn_weight},
         };
-        OpGenerator<SetOperator>** generators = new OpGenerator<SetOperator>*[config.threads];
-        for (int i = 0; i < config.threads; i++) {
-            generators[i] = new OpGenerator(op_weights, OP_COUNT, config.value_mod, DEFAULT_GENERATOR_SEED + i);
+    }
+
+    /// Returns the number of elements stored in a set.
+    uint64_t stored_elements(Set* set, BenchConfig& config, SetOperator) {
+        uint64_t count = 0;
+        for (int value = 0; value < config.value_mod; value++) {
+            Operation<SetOperator> operation(SetOperator::Contains, value);
+            count += apply_op(set, operation);
         }
+        return count;
+    }
 
-        Set set;
-        double start = time_now();
-        run_data_structure_n_threads<Set, SetOperator>(&set, generators, config.threads);
-        double end = time_now();
+    /// Returns the number of elements stored in a multiset, counting every
+    /// copy of a value.
+    uint64_t stored_elements(Multiset* set, BenchConfig& config, MultisetOperator) {
+        uint64_t count = 0;
+        for (int value = 0; value < config.value_mod; value++) {
+            Operation<MultisetOperator> operation(MultisetOperator::MSetCount, value);
+            count += apply_op(set, operation);
+        }
+        return count;
+    }
 
-        print_table_row(set_name, config, end - start);
+    /// Creates the generator for the given configuration. Every thread
+    /// performs `config.op_count` operations.
+    template <typename Op>
+    OpGenerator<Op> create_generator(BenchConfig& config) {
+        return OpGenerator<Op>(
+            op_weights(config, Op()),
+            config.op_count * config.threads,
+            config.value_mod,
+            config.seed,
+            config.distribution
+        );
+    }
+
+    /// The tapes cached by `get_tapes`, by configuration.
+    template <typename Op>
+    std::map<std::string, std::vector<OpTape<Op>>> tape_cache;
+
+    /// Frees the cached tapes of all operator types.
+    void clear_tapes() {
+        tape_cache<SetOperator>.clear();
+        tape_cache<MultisetOperator>.clear();
+    }
+
+    /// Returns one tape per thread for the given configuration. The tapes
+    /// are generated once and cached until `clear_tapes` is called, every
+    /// data structure therefore runs exactly the same operations.
+    template <typename Op>
+    std::vector<OpTape<Op>>* get_tapes(BenchConfig& config) {
+        std::map<std::string, std::vector<OpTape<Op>>>& cache = tape_cache<Op>;
 
-        for (int i = 0; i < config.threads; i++) {
-            delete generators[i];
+        // The key has to cover every field used by `create_generator`. The
+        // name rounds the parameters, they are therefore added separately.
+        char key[160];
+        snprintf(
+            key,
+            sizeof(key),
+            "%s/%f/%f/%f/%d/%d/%d/%d/%d/%d/%d",
+            config.distribution.name().c_str(),
+            config.distribution.theta,
+            config.distribution.hot_set,
+            config.distribution.hot_ops,
+            config.value_mod,
+            config.ctn_weight,
+            config.add_weight,
+            config.rmv_weight,
+            config.threads,
+            config.op_count,
+            config.seed
+        );
+        auto it = cache.find(key);
+        if (it == cache.end()) {
+            OpGenerator<Op> generator = create_generator<Op>(config);
+            it = cache.emplace(key, record_tapes(&generator, config.threads)).first;
+        }
+        return &it->second;
+    }
+
+    /// Inserts `config.prefill` of the keys into the data structure, spread
+    /// evenly over the key range. This uses the inserting operator of the
+    /// configured operation mix.
+    template <class DS, typename Op>
+    void prefill(DS* data_structure, BenchConfig& config) {
+        int count = config.prefill * config.value_mod;
+        for (const OpWeights<Op>& weights : op_weights(config, Op())) {
+            if (!is_insert(weights.op)) {
+                continue;
+            }
+            for (int i = 0; i < count; i++) {
+                Operation<Op> operation(weights.op, (long)i * config.value_mod / count);
+                apply_op(data_structure, operation);
+            }
+            return;
+        }
+    }
+
+    /// Runs `config.warmup` untimed runs and `config.repetitions` timed runs
+    /// of the configuration. Every run uses a fresh data structure. The
+    /// latencies of the timed runs are added to `latencies`, if given. For
+    /// duration runs, the throughput of every thread of the timed runs is
+    /// added to `thread_throughputs`, if given. The events counted in the
+    /// timed runs are added to `counters`, and the contention counters of
+    /// the timed runs to `contention`, if given.
+    template <class DS, typename Op>
+    RunStats measure_config(
+        BenchConfig& config,
+        OpHistograms<Op>* latencies = nullptr,
+        std::vector<double>* thread_throughputs = nullptr,
+        CounterTotals* counters = nullptr,
+        ContentionTotals* contention = nullptr
+    ) {
+        std::vector<OpTape<Op>>* tapes = get_tapes<Op>(config);
+
+        std::vector<double> throughputs;
+        for (int run = 0; run < config.warmup + config.repetitions; run++) {
+            bool is_timed = run >= config.warmup;
+            DS* data_structure = new DS;
+            prefill<DS, Op>(data_structure, config);
+            if (contention) {
+                reset_contention();
+            }
+
+            uint64_t ops = 0;
+            double time;
+            if (config.duration <= 0.0) {
+                time = run_data_structure_n_threads<DS, Op>(
+                    data_structure,
+                    tapes,
+                    is_timed ? latencies : nullptr,
+                    config.placement,
+                    is_timed ? counters : nullptr
+                );
+                ops = config.threads * config.op_count;
+            } else {
+                std::vector<uint64_t> completed;
+                time = run_data_structure_for_duration<DS, Op>(
+                    data_structure,
+                    tapes,
+                    config.duration,
+                    &completed,
+                    is_timed ? latencies : nullptr,
+                    config.placement,
+                    is_timed ? counters : nullptr
+                );
+                for (uint64_t count : completed) {
+                    ops += count;
+                    if (is_timed && thread_throughputs) {
+                        thread_throughputs->push_back(count / time);
+                    }
+                }
+            }
+
+            if (is_timed) {
+                throughputs.push_back(ops / time);
+                if (counters) {
+                    counters->ops += ops;
+                }
+                if (contention) {
+                    ContentionTotals totals = contention_totals();
+                    totals.ops = ops;
+                    contention->merge(totals);
+                }
+            }
+            delete data_structure;
+        }
+        return RunStats(throughputs);
+    }
+
+    /// Runs the configuration once more with memory tracking and adds its
+    /// memory use to `memory`. The run isn't timed, since the tracking
+    /// updates shared counters on every allocation. The workers only count
+    /// the allocations of their operations, not those of the harness.
+    template <class DS, typename Op>
+    void measure_memory(BenchConfig& config, MemoryTotals* memory) {
+        std::vector<OpTape<Op>>* tapes = get_tapes<Op>(config);
+        set_memory_tracking(true);
+
+        // The structure is allocated on the heap, so that its own size is
+        // part of its memory use
+        MemorySnapshot before = memory_snapshot();
+        reset_memory_peak();
+        DS* data_structure = new DS;
+        prefill<DS, Op>(data_structure, config);
+
+        std::vector<uint64_t> allocations;
+        uint64_t ops = 0;
+        if (config.duration <= 0.0) {
+            run_data_structure_n_threads<DS, Op>(
+                data_structure,
+                tapes,
+                nullptr,
+                config.placement,
+                nullptr,
+                &allocations
+            );
+            ops = config.threads * config.op_count;
+        } else {
+            std::vector<uint64_t> completed;
+            run_data_structure_for_duration<DS, Op>(
+                data_structure,
+                tapes,
+                config.duration,
+                &completed,
+                nullptr,
+                config.placement,
+                nullptr,
+                &allocations
+            );
+            for (uint64_t count : completed) {
+                ops += count;
+            }
+        }
+
+        MemorySnapshot after = memory_snapshot();
+        memory->runs += 1;
+        memory->live += after.live - before.live;
+        memory->peak += after.peak - before.live;
+        for (uint64_t count : allocations) {
+            memory->allocations += count;
+        }
+        memory->ops += ops;
+        memory->elements += stored_elements(data_structure, config, Op());
+
+        delete data_structure;
+        memory->leaked += memory_snapshot().live - before.live;
+        set_memory_tracking(false);
+    }
+
+    template <class DS, typename Op = SetOperator>
+    void run_config(char const* ds_name, BenchConfig& config) {
+        if (config.rate > 0.0) {
+            std::vector<OpTape<Op>>* tapes = get_tapes<Op>(config);
+            DS data_structure;
+            prefill<DS, Op>(&data_structure, config);
+            // Every thread offers an equal share of the rate
+            double interval = config.threads * 1000000.0 / config.rate;
+            OpenLoopTimes times = run_data_structure_n_threads_open_loop<DS, Op>(
+                &data_structure,
+                tapes,
+                config.arrival,
+                interval,
+                config.seed
+            );
+            // The thread creation and the start delay aren't part of the
+            // schedule, they are therefore excluded from the achieved rate
+            double time = 0.0;
+            if (times.last_completion > times.first_arrival) {
+                time = (times.last_completion - times.first_arrival) / 1000000.0;
+            }
+            print_open_loop_row(ds_name, config, time, times.latencies);
+            return;
+        }
+
+        OpHistograms<Op> latencies;
+        std::vector<double> thread_throughputs;
+        CounterTotals counters;
+        ContentionTotals contention;
+        MemoryTotals memory;
+        RunStats stats = measure_config<DS, Op>(
+            config,
+            config.latencies ? &latencies : nullptr,
+            &thread_throughputs,
+            config.counters ? &counters : nullptr,
+            INSTRUMENT_ENABLED || PHASE_TIMERS_ENABLED ? &contention : nullptr
+        );
+        if (config.memory) {
+            reset_peak_rss();
+            measure_memory<DS, Op>(config, &memory);
+            memory.peak_rss_kib = peak_rss_kib();
+        }
+        if (config.duration > 0.0) {
+            print_duration_row(ds_name, config, stats, thread_throughputs);
+        } else {
+            print_table_row(ds_name, config, stats);
+        }
+        record_result(ds_name, config, stats);
+        if (config.counters) {
+            print_counter_rows(counters);
+        }
+        if (INSTRUMENT_ENABLED) {
+            print_contention_rows(contention);
+        }
+        if (PHASE_TIMERS_ENABLED) {
+            print_phase_rows(contention);
+        }
+        if (config.memory) {
+            print_memory_rows(memory);
+        }
+        if (config.latencies) {
+            print_latency_rows(latencies);
         }
-        delete[] generators;
     }
 
     template <class Set>
     void benchmark_set(char const* set_name) {
         print_table_header();
 
+        for (KeyDistribution distribution : KEY_DISTRIBUTIONS) {
+            for (int value_mod : VALUE_MODS) {
+                for (int ctn_weight : CTN_WEIGHTS) {
+                    for (int threads : THREAD_COUNTS) {
+                        BenchConfig config = BenchConfig(value_mod, ctn_weight, threads, distribution);
+                        run_config<Set>(set_name, config);
+                    }
+                }
+            }
+        }
+    }
+
+    /// Runs the configuration for `DS`, which reports to the given monitor
+    /// policy, and returns the time in ms. Only the workers are timed, the
+    /// validation of the remaining events afterwards is not included.
+    template <class DS, typename Op, class Monitor>
+    double time_monitored_config(BenchConfig& config, Monitor* monitor) {
+        std::vector<OpTape<Op>>* tapes = get_tapes<Op>(config);
+        DS data_structure(monitor);
+
+        std::thread monitor_thread;
+        if constexpr (Monitor::enabled) {
+            monitor_thread = std::thread(monitor_thread_func<Monitor>, monitor);
+        }
+
+        double time = run_data_structure_n_threads<DS, Op>(&data_structure, tapes);
+
+        if constexpr (Monitor::enabled) {
+            monitor->finish();
+            monitor_thread.join();
+        }
+
+        return time;
+    }
+
+    /// Replays the trace against a fresh `DS`. The trace has to contain `Op`
+    /// operations.
+    template <class DS, typename Op>
+    void run_replay(char const* ds_name, TraceReader* trace, ReplayMode mode) {
+        std::vector<std::vector<uint64_t>> threads = split_trace(trace);
+
+        DS data_structure;
+        double start = time_now();
+        std::vector<uint64_t> latencies = replay_trace_n_threads<DS, Op>(&data_structure, trace, &threads, mode);
+        double end = time_now();
+
+        print_replay_row(ds_name, threads.size(), mode, end - start, latencies);
+    }
+
+    /// Compares `DS` without a monitor to `DS` with the validating `Monitor`,
+    /// which checks the events against the sequential data structure `RefDS`.
+    /// The monitor is measured with full validation and with sampled keys.
+    /// Configurations, where a monitor finds a violation, are reported on
+    /// stderr and left out of the table.
+    template <template <typename> class DS, class Monitor, class RefDS, typename Op>
+    void benchmark_monitor_overhead(char const* ds_name) {
+        printf("          name,  values, ctn [%%], add [%%], rmv [%%], threads, time [ms], monitored [ms], overhead, sampled [ms], overhead\n");
+
         for (int value_mod : VALUE_MODS) {
             for (int ctn_weight : CTN_WEIGHTS) {
                 for (int threads : THREAD_COUNTS) {
                     BenchConfig config = BenchConfig(value_mod, ctn_weight, threads);
-                    run_config<Set>(set_name, config);
+
+                    NullMonitor<Op> null_monitor;
+                    double time = time_monitored_config<DS<NullMonitor<Op>>, Op>(config, &null_monitor);
+
+                    // The reports of the monitors would break up the table
+                    RefDS reference;
+                    Monitor monitor(&reference);
+                    monitor.set_quiet(true);
+                    double monitored = time_monitored_config<DS<Monitor>, Op>(config, &monitor);
+
+                    RefDS sampled_reference;
+                    Monitor sampled_monitor(&sampled_reference);
+                    sampled_monitor.set_quiet(true);
+                    sampled_monitor.set_sample_rate(MONITOR_SAMPLE_RATE);
+                    double sampled = time_monitored_config<DS<Monitor>, Op>(config, &sampled_monitor);
+
+                    if (!monitor.is_valid() || !sampled_monitor.is_valid()) {
+                        fprintf(
+                            stderr,
+                            "%s: validation failed with %d threads and ctn %d%% on 0..%d, skipping the row\n",
+                            ds_name,
+                            config.threads,
+                            config.ctn_weight,
+                            config.value_mod
+                        );
+                        continue;
+                    }
+
+                    printf(
+                        "%14s, 0..%-4d,     %3d,     %3d,     %3d,      %2d, %9.4f,      %9.4f, %7.2fx,    %9.4f, %7.2fx\n",
+                        ds_name,
+                        config.value_mod,
+                        config.ctn_weight,
+                        config.get_add_weight(),
+                        config.get_rmv_weight(),
+                        config.threads,
+                        time,
+                        monitored,
+                        monitored / time,
+                        sampled,
+                        sampled / time
+                    );
                 }
             }
         }
     }
+
+    /// Reserves and completes `count` events, which are always valid for
+    /// an empty set.
+    void monitor_producer_thread_func(SetMonitor* monitor, int count) {
+        for (int i = 0; i < count; i++) {
+            SetEvent* event = monitor->reserve(SetEvent(SetOperator::Contains, i));
+            event->complete(false);
+        }
+    }
+
+    /// Measures the throughput of the `EventMonitor`, from the first
+    /// reserved event until the last event has been validated.
+    void benchmark_monitor() {
+        printf("producers,   events, time [ms], events/ms\n");
+
+        for (int threads : MONITOR_THREAD_COUNTS) {
+            StdSet test_set;
+            SetMonitor monitor(&test_set);
+            int count = MONITOR_EVENT_COUNT / threads;
+
+            double start = time_now();
+            std::thread monitor_thread(monitor_thread_func<SetMonitor>, &monitor);
+            std::vector<std::thread> producers;
+            for (int i = 0; i < threads; i++) {
+                producers.push_back(std::thread(monitor_producer_thread_func, &monitor, count));
+            }
+            for (std::thread& producer : producers) {
+                producer.join();
+            }
+            monitor.finish();
+            monitor_thread.join();
+            double end = time_now();
+
+            printf(
+                "       %2d, %8d, %9.4f, %9.1f\n",
+                threads,
+                threads * count,
+                end - start,
+                threads * count / (end - start)
+            );
+        }
+    }
 }
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <stdio.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/// An event counted by `PerfCounterGroup`, see `perf_event_open(2)`.
+struct CounterEvent {
+    char const* name;
+    uint32_t type;
+    uint64_t config;
+};
+
+#ifdef __linux__
+/// The cache event selecting read misses of the given cache.
+#define CACHE_READ_MISSES(cache) \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+const CounterEvent COUNTER_EVENTS[] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"L1d misses", PERF_TYPE_HW_CACHE, CACHE_READ_MISSES(PERF_COUNT_HW_CACHE_L1D)},
+    {"LLC misses", PERF_TYPE_HW_CACHE, CACHE_READ_MISSES(PERF_COUNT_HW_CACHE_LL)},
+    {"branch misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"context switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+};
+#else
+const CounterEvent COUNTER_EVENTS[] = {
+    {"cycles", 0, 0},
+    {"instructions", 0, 0},
+    {"L1d misses", 0, 0},
+    {"LLC misses", 0, 0},
+    {"branch misses", 0, 0},
+    {"context switches", 0, 0},
+};
+#endif
+
+/// The indices of the events in `COUNTER_EVENTS`.
+enum CounterIndex {
+    CounterCycles = 0,
+    CounterInstructions = 1,
+    CounterL1dMisses = 2,
+    CounterLlcMisses = 3,
+    CounterBranchMisses = 4,
+    CounterContextSwitches = 5,
+};
+
+#define COUNTER_EVENT_COUNT (sizeof(COUNTER_EVENTS) / sizeof(COUNTER_EVENTS[0]))
+
+/// The counts of several threads and runs. An event is only available, if
+/// it was counted by every group merged into the totals.
+struct CounterTotals {
+    double values[COUNTER_EVENT_COUNT] = {};
+    /// The number of groups, which counted the event.
+    uint64_t counted[COUNTER_EVENT_COUNT] = {};
+    /// The number of groups merged into the totals.
+    uint64_t groups = 0;
+    /// The operations performed while counting, set by the caller.
+    uint64_t ops = 0;
+
+    bool is_available(CounterIndex index) const {
+        return this->groups > 0 && this->counted[index] == this->groups;
+    }
+
+    /// Returns the count of the event per operation.
+    double per_op(CounterIndex index) const {
+        return this->ops == 0 ? 0.0 : this->values[index] / this->ops;
+    }
+
+    void merge(const CounterTotals& other) {
+        for (size_t i = 0; i < COUNTER_EVENT_COUNT; i++) {
+            this->values[i] += other.values[i];
+            this->counted[i] += other.counted[i];
+        }
+        this->groups += other.groups;
+        this->ops += other.ops;
+    }
+};
+
+/// The events of `COUNTER_EVENTS` counted for the calling thread, as a
+/// single perf group, so that all events cover the same instructions.
+/// Events the kernel or the hardware doesn't support, e.g. in virtual
+/// machines, are skipped. The reason is printed once per event.
+class PerfCounterGroup {
+public:
+    /// Opens the counters of the calling thread. They don't count until
+    /// `start` is called.
+    PerfCounterGroup() {
+        for (size_t i = 0; i < COUNTER_EVENT_COUNT; i++) {
+            this->fds[i] = open_event(COUNTER_EVENTS[i], this->leader);
+            if (this->fds[i] >= 0 && this->leader < 0) {
+                this->leader = this->fds[i];
+            }
+        }
+    }
+
+    ~PerfCounterGroup() {
+#ifdef __linux__
+        for (int fd : this->fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+#endif
+    }
+
+    PerfCounterGroup(const PerfCounterGroup&) = delete;
+    PerfCounterGroup& operator=(const PerfCounterGroup&) = delete;
+
+    void start() {
+#ifdef __linux__
+        if (this->leader >= 0) {
+            ioctl(this->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(this->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+#endif
+    }
+
+    /// Stops counting and adds the counts to `totals`. If the group was
+    /// multiplexed with other groups, the counts are scaled to the time
+    /// the group was enabled.
+    void stop(CounterTotals* totals) {
+        totals->groups += 1;
+#ifdef __linux__
+        if (this->leader < 0) {
+            return;
+        }
+        ioctl(this->leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+        // The format selected by `open_event`
+        uint64_t buffer[3 + COUNTER_EVENT_COUNT];
+        if (read(this->leader, buffer, sizeof(buffer)) < (ssize_t)(3 * sizeof(uint64_t))) {
+            return;
+        }
+        uint64_t enabled = buffer[1];
+        uint64_t running = buffer[2];
+        double scale = running > 0 && running < enabled ? (double)enabled / running : 1.0;
+
+        size_t value = 3;
+        for (size_t i = 0; i < COUNTER_EVENT_COUNT && value < 3 + buffer[0]; i++) {
+            if (this->fds[i] < 0) {
+                continue;
+            }
+            totals->values[i] += buffer[value] * scale;
+            totals->counted[i] += 1;
+            value += 1;
+        }
+#endif
+    }
+
+private:
+    /// Opens the event as part of the group of `leader`, or as a new group
+    /// if `leader` is -1. Returns -1 on failure.
+    static int open_event(const CounterEvent& event, int leader) {
+#ifdef __linux__
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = event.type;
+        attr.config = event.config;
+        attr.disabled = leader < 0;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        int fd = syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+        if (fd < 0 && (errno == EACCES || errno == EPERM)) {
+            // Restricted by `perf_event_paranoid`, count user space only
+            attr.exclude_kernel = 1;
+            fd = syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+        }
+        if (fd >= 0) {
+            return fd;
+        }
+        report_unavailable(event, strerror(errno));
+#else
+        report_unavailable(event, "not supported on this platform");
+#endif
+        return -1;
+    }
+
+    static void report_unavailable(const CounterEvent& event, char const* reason) {
+        static std::atomic<bool> reported[COUNTER_EVENT_COUNT];
+        if (!reported[&event - COUNTER_EVENTS].exchange(true)) {
+            fprintf(stderr, "The counter `%s` is unavailable: %s\n", event.name, reason);
+        }
+    }
+
+    int fds[COUNTER_EVENT_COUNT];
+    int leader = -1;
+};
@@ -2,6 +2,7 @@
 
 #include "set.hpp"
 #include "std_set.hpp"
+#include "instrument.hpp"
 
 #include <mutex>
 
@@ -11,24 +12,23 @@ struct FineMultisetNode {
   // A06: You can add or remove fields as needed.
   int value;
   FineMultisetNode *next;
-  std::mutex lock;
+  InstrumentedMutex lock;
 
   FineMultisetNode(int elem = INT_MIN, FineMultisetNode *nextN = nullptr)
       : value(elem), next(nextN) {}
 };
 
 /// A multiset implementation using a linked list with fine grained locking.
+template <typename Monitor = NullMonitor<MultisetOperator>>
 class FineMultiset : public Multiset {
 private:
   // A06: You can add or remove fields as needed.
   FineMultisetNode *head;
   FineMultisetNode *tail;
-  EventMonitor<FineMultiset, StdMultiset, MultisetOperator> *monitor;
+  Monitor *monitor;
 
 public:
-  FineMultiset(
-      EventMonitor<FineMultiset, StdMultiset, MultisetOperator> *monitor)
-      : monitor(monitor) {
+  FineMultiset(Monitor *monitor = Monitor::instance()) : monitor(monitor) {
     // A06: Initiate the internal state
     this->tail = new FineMultisetNode(INT_MAX, nullptr);
     this->head = new FineMultisetNode(INT_MIN, this->tail);
@@ -51,28 +51,37 @@ public:
     //      the linearization point.
 
     // Lock
+    PHASE_BEGIN();
     head->lock.lock();
     FineMultisetNode *current = head;
     FineMultisetNode *next = current->next;
     next->lock.lock();
+    PHASE_MARK(PhaseLock);
 
     // Traversing list to correct position
     while (next->value < elem) {
       current->lock.unlock();
       current = next;
       next = next->next;
+      PHASE_MARK(PhaseTraversal);
       next->lock.lock();
+      PHASE_MARK(PhaseLock);
     }
+    PHASE_MARK(PhaseTraversal);
 
     // Insert element
-    current->next = new FineMultisetNode(elem, next);
+    FineMultisetNode *node = new FineMultisetNode(elem, next);
+    PHASE_MARK(PhaseAllocation);
+    current->next = node;
 
     // Record operation
     this->monitor->add(MultisetEvent(MultisetOperator::MSetAdd, elem, result));
+    PHASE_MARK(PhaseLinearization);
 
     // Unlock
     next->lock.unlock();
     current->lock.unlock();
+    PHASE_MARK(PhaseLock);
 
     return result;
   }
@@ -84,33 +93,42 @@ public:
     //      the linearization point.
 
     // Lock
+    PHASE_BEGIN();
     head->lock.lock();
     FineMultisetNode *current = head;
     FineMultisetNode *next = head->next;
     next->lock.lock();
+    PHASE_MARK(PhaseLock);
 
     // Traversing list to correct position
     while (next->value < elem) {
       current->lock.unlock();
       current = next;
       next = next->next;
+      PHASE_MARK(PhaseTraversal);
       next->lock.lock();
+      PHASE_MARK(PhaseLock);
     }
+    PHASE_MARK(PhaseTraversal);
 
     // Remove element if found
     if (next->value == elem) {
       current->next = next->next;
+      PHASE_MARK(PhaseLinearization);
       delete next;
+      PHASE_MARK(PhaseReclamation);
       result = true;
     }
 
     // Record operation
     this->monitor->add(
         MultisetEvent(MultisetOperator::MSetRemove, elem, result));
+    PHASE_MARK(PhaseLinearization);
 
     // Unlock
     current->lock.unlock();
     next->lock.unlock();
+    PHASE_MARK(PhaseLock);
 
     return result;
   }
@@ -131,11 +149,13 @@ public:
     //      of these function.
 
     // Lock list from new threads
+    PHASE_BEGIN();
     head->lock.lock();
 
     // Lock next step
     FineMultisetNode *current = head->next;
     current->lock.lock();
+    PHASE_MARK(PhaseLock);
 
     // Traverse list
     while (current != nullptr) {
@@ -145,20 +165,24 @@ public:
 
       // Take a step
       FineMultisetNode *next = current->next;
+      PHASE_MARK(PhaseTraversal);
       if (next != nullptr)
         next->lock.lock();
 
       // Unlock previous step
       current->lock.unlock();
+      PHASE_MARK(PhaseLock);
       current = next;
     }
 
     // Record operation
     this->monitor->add(
         MultisetEvent(MultisetOperator::MSetCount, elem, result));
+    PHASE_MARK(PhaseLinearization);
 
     // Unlock list
     head->lock.unlock();
+    PHASE_MARK(PhaseLock);
     return result;
   }
 
@@ -2,6 +2,7 @@
 
 #include "set.hpp"
 #include "std_set.hpp"
+#include "instrument.hpp"
 
 #include <mutex>
 
@@ -13,7 +14,7 @@
 struct FineSetNode {
   int value;
   FineSetNode *next;
-  std::mutex lock;
+  InstrumentedMutex lock;
 
   FineSetNode(int elem, FineSetNode *nextN) : value(elem), next(nextN) {}
 };
@@ -41,30 +42,39 @@ public:
   bool add(int elem) override {
     bool result = false;
 
+    PHASE_BEGIN();
     head->lock.lock();
     FineSetNode *current = head;
     FineSetNode *next = head->next;
     if (next != nullptr)
       next->lock.lock();
+    PHASE_MARK(PhaseLock);
 
     // Traversing list to correct position
     while (next != nullptr && next->value < elem) {
       current->lock.unlock();
       current = next;
       next = next->next;
+      PHASE_MARK(PhaseTraversal);
       if (next != nullptr)
         next->lock.lock();
+      PHASE_MARK(PhaseLock);
     }
+    PHASE_MARK(PhaseTraversal);
 
     if (next == nullptr || next->value > elem) {
       // Add element if element exist
-      current->next = new FineSetNode(elem, current->next);
+      FineSetNode *node = new FineSetNode(elem, current->next);
+      PHASE_MARK(PhaseAllocation);
+      current->next = node;
       result = true;
     }
 
+    PHASE_MARK(PhaseLinearization);
     if (next != nullptr)
       next->lock.unlock();
     current->lock.unlock();
+    PHASE_MARK(PhaseLock);
 
     return result;
   }
@@ -72,31 +82,40 @@ public:
   bool rmv(int elem) override {
     bool result = false;
 
+    PHASE_BEGIN();
     head->lock.lock();
     FineSetNode *current = head;
     FineSetNode *next = head->next;
     if (next != nullptr)
       next->lock.lock();
+    PHASE_MARK(PhaseLock);
 
     // Traversing list to correct position
     while (next != nullptr && next->value < elem) {
       current->lock.unlock();
       current = next;
       next = next->next;
+      PHASE_MARK(PhaseTraversal);
       if (next != nullptr)
         next->lock.lock();
+      PHASE_MARK(PhaseLock);
     }
+    PHASE_MARK(PhaseTraversal);
 
     if (next != nullptr && next->value == elem) {
       // Remove element if element exist
       current->next = next->next;
+      PHASE_MARK(PhaseLinearization);
       delete next;
+      PHASE_MARK(PhaseReclamation);
       result = true;
     }
 
+    PHASE_MARK(PhaseLinearization);
     if (next != nullptr)
       next->lock.unlock();
     current->lock.unlock();
+    PHASE_MARK(PhaseLock);
 
     return result;
   }
@@ -104,29 +123,36 @@ public:
   bool ctn(int elem) override {
     bool result = false;
 
+    PHASE_BEGIN();
     head->lock.lock();
     FineSetNode *current = head;
     FineSetNode *next = head->next;
     if (next != nullptr)
       next->lock.lock();
+    PHASE_MARK(PhaseLock);
 
     // Traversing list to correct position
     while (next != nullptr && next->value < elem) {
       current->lock.unlock();
       current = next;
       next = next->next;
+      PHASE_MARK(PhaseTraversal);
       if (next != nullptr)
         next->lock.lock();
+      PHASE_MARK(PhaseLock);
     }
+    PHASE_MARK(PhaseTraversal);
 
     if (next != nullptr && next->value == elem) {
       // Set true if value exist in list
       result = true;
     }
 
+    PHASE_MARK(PhaseLinearization);
     if (next != nullptr)
       next->lock.unlock();
     current->lock.unlock();
+    PHASE_MARK(PhaseLock);
 
     return result;
   }
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/// Values below `2 * HISTOGRAM_SUB_BUCKETS` are counted exactly. Above, every
+/// power of two is split into `HISTOGRAM_SUB_BUCKETS` buckets, which bounds
+/// the relative error of a value to `1 / HISTOGRAM_SUB_BUCKETS`.
+#define HISTOGRAM_SUB_BUCKET_BITS 5
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BUCKET_BITS)
+
+/// A histogram with logarithmic buckets, like HdrHistogram. Recording a
+/// value is a few bit operations and an increment, and the memory only
+/// grows with the logarithm of the largest value. Every thread records
+/// into its own histogram, which are merged afterwards.
+class LatencyHistogram {
+public:
+    void record(uint64_t value) {
+        size_t index = bucket_index(value);
+        if (index >= this->counts.size()) {
+            this->counts.resize(index + 1, 0);
+        }
+        this->counts[index] += 1;
+        this->total += 1;
+        this->maximum = std::max(this->maximum, value);
+    }
+
+    void merge(const LatencyHistogram& other) {
+        if (other.counts.size() > this->counts.size()) {
+            this->counts.resize(other.counts.size(), 0);
+        }
+        for (size_t i = 0; i < other.counts.size(); i++) {
+            this->counts[i] += other.counts[i];
+        }
+        this->total += other.total;
+        this->maximum = std::max(this->maximum, other.maximum);
+    }
+
+    uint64_t count() const {
+        return this->total;
+    }
+
+    uint64_t max() const {
+        return this->maximum;
+    }
+
+    /// Returns the value at the given quantile in `[0, 1]`. This is the
+    /// highest value of the bucket containing the quantile, but never more
+    /// than the largest recorded value.
+    uint64_t percentile(double quantile) const {
+        uint64_t rank = std::max((uint64_t)1, (uint64_t)std::ceil(quantile * this->total));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < this->counts.size(); i++) {
+            seen += this->counts[i];
+            if (seen >= rank) {
+                return std::min(bucket_max(i), this->maximum);
+            }
+        }
+        return this->maximum;
+    }
+
+private:
+    static size_t bucket_index(uint64_t value) {
+        if (value < 2 * HISTOGRAM_SUB_BUCKETS) {
+            return value;
+        }
+        int shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BUCKET_BITS;
+        return shift * HISTOGRAM_SUB_BUCKETS + (value >> shift);
+    }
+
+    static uint64_t bucket_max(size_t index) {
+        if (index < 2 * HISTOGRAM_SUB_BUCKETS) {
+            return index;
+        }
+        int shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+        uint64_t mantissa = index - shift * HISTOGRAM_SUB_BUCKETS;
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+    std::vector<uint64_t> counts;
+    uint64_t total = 0;
+    uint64_t maximum = 0;
+};
+
+/// One histogram per operator, indexed by the numeric value of the operator.
+template<typename Op>
+struct OpHistograms {
+    std::vector<LatencyHistogram> histograms;
+
+    void record(Op op, uint64_t value) {
+        if ((size_t)op >= this->histograms.size()) {
+            this->histograms.resize((size_t)op + 1);
+        }
+        this->histograms[op].record(value);
+    }
+
+    void merge(const OpHistograms<Op>& other) {
+        if (other.histograms.size() > this->histograms.size()) {
+            this->histograms.resize(other.histograms.size());
+        }
+        for (size_t op = 0; op < other.histograms.size(); op++) {
+            this->histograms[op].merge(other.histograms[op]);
+        }
+    }
+};
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/// The contention instrumentation is only compiled in with `-DINSTRUMENT`,
+/// for example with `make instrument`. Otherwise `INSTRUMENT_COUNT` expands
+/// to nothing and `InstrumentedMutex` is a plain `std::mutex`.
+#ifdef INSTRUMENT
+const bool INSTRUMENT_ENABLED = true;
+#else
+const bool INSTRUMENT_ENABLED = false;
+#endif
+
+/// The phase timers are only compiled in with `-DPHASE_TIMERS`, for example
+/// with `make phases`. They are separate from `INSTRUMENT`, since reading
+/// the time stamp counter around every step slows the operations down.
+#ifdef PHASE_TIMERS
+const bool PHASE_TIMERS_ENABLED = true;
+#else
+const bool PHASE_TIMERS_ENABLED = false;
+#endif
+
+/// The events counted by the instrumentation.
+enum ContentionCounter {
+    /// A CAS of a lock-free structure failed, because another thread
+    /// changed the value first.
+    ContentionCasFailures = 0,
+    /// `LockFreeSet::find` failed to unlink a marked node.
+    ContentionSnipFailures = 1,
+    /// `LazySet::locate` found a changed window after locking it.
+    ContentionLocateRetries = 2,
+    /// `OptimisticSet::validate` found a changed window after locking it.
+    ContentionValidateFailures = 3,
+    /// The acquisitions of an `InstrumentedMutex`.
+    ContentionLockAcquisitions = 4,
+    /// The acquisitions, where the mutex was held by another thread.
+    ContentionLockContended = 5,
+    /// The ns spent waiting for a mutex.
+    ContentionLockWaitNs = 6,
+    /// The ns a mutex was held.
+    ContentionLockHoldNs = 7,
+};
+
+#define CONTENTION_COUNTER_COUNT 8
+
+/// The phases of an operation, which the phase timers attribute cycles to.
+enum OperationPhase {
+    /// Following pointers to the position of the operation.
+    PhaseTraversal = 0,
+    /// Acquiring and releasing locks.
+    PhaseLock = 1,
+    /// Checking that a locked window is still valid.
+    PhaseValidation = 2,
+    /// Allocating new nodes.
+    PhaseAllocation = 3,
+    /// The update or CAS at the linearization point, and the monitor event.
+    PhaseLinearization = 4,
+    /// Unlinking and freeing removed nodes.
+    PhaseReclamation = 5,
+};
+
+#define OPERATION_PHASE_COUNT 6
+
+char const* phase_name(OperationPhase phase) {
+    switch (phase) {
+        case PhaseTraversal:
+            return "traversal";
+        case PhaseLock:
+            return "lock";
+        case PhaseValidation:
+            return "validation";
+        case PhaseAllocation:
+            return "allocation";
+        case PhaseLinearization:
+            return "linearization";
+        case PhaseReclamation:
+            return "reclamation";
+        default:
+            return "unknown";
+    }
+}
+
+/// The counters of one or more threads.
+struct ContentionTotals {
+    uint64_t counts[CONTENTION_COUNTER_COUNT] = {};
+    /// The time stamp counter cycles spent in every phase.
+    uint64_t phase_cycles[OPERATION_PHASE_COUNT] = {};
+    /// The operations performed while counting, set by the caller.
+    uint64_t ops = 0;
+
+    /// Returns the count per operation.
+    double per_op(ContentionCounter counter) const {
+        return this->ops == 0 ? 0.0 : (double)this->counts[counter] / this->ops;
+    }
+
+    /// Returns the count per lock acquisition.
+    double per_lock(ContentionCounter counter) const {
+        uint64_t acquisitions = this->counts[ContentionLockAcquisitions];
+        return acquisitions == 0 ? 0.0 : (double)this->counts[counter] / acquisitions;
+    }
+
+    void merge(const ContentionTotals& other) {
+        for (int i = 0; i < CONTENTION_COUNTER_COUNT; i++) {
+            this->counts[i] += other.counts[i];
+        }
+        for (int i = 0; i < OPERATION_PHASE_COUNT; i++) {
+            this->phase_cycles[i] += other.phase_cycles[i];
+        }
+        this->ops += other.ops;
+    }
+};
+
+/// The counters of all threads. Every thread only writes its own counters,
+/// so counting needs no synchronization. They have to be read, while the
+/// threads are idle.
+struct ContentionRegistry {
+    std::mutex lock;
+    std::vector<ContentionTotals*> threads;
+    /// The counters of threads, which already exited.
+    ContentionTotals exited;
+};
+
+/// The registry is never destroyed, since threads might still exit after
+/// the static destructors ran.
+ContentionRegistry& contention_registry() {
+    static ContentionRegistry* registry = new ContentionRegistry;
+    return *registry;
+}
+
+/// The counters of a single thread, registered for its lifetime.
+struct ThreadContention {
+    ContentionTotals totals;
+
+    ThreadContention() {
+        ContentionRegistry& registry = contention_registry();
+        std::lock_guard<std::mutex> guard(registry.lock);
+        registry.threads.push_back(&this->totals);
+    }
+
+    ~ThreadContention() {
+        ContentionRegistry& registry = contention_registry();
+        std::lock_guard<std::mutex> guard(registry.lock);
+        registry.exited.merge(this->totals);
+        std::erase(registry.threads, &this->totals);
+    }
+};
+
+/// Returns the counters of the calling thread.
+ContentionTotals& thread_contention() {
+    thread_local ThreadContention contention;
+    return contention.totals;
+}
+
+/// Returns the sum of the counters of all threads.
+ContentionTotals contention_totals() {
+    ContentionRegistry& registry = contention_registry();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    ContentionTotals totals = registry.exited;
+    for (ContentionTotals* thread : registry.threads) {
+        totals.merge(*thread);
+    }
+    return totals;
+}
+
+/// Sets the counters of all threads to zero.
+void reset_contention() {
+    ContentionRegistry& registry = contention_registry();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    registry.exited = ContentionTotals();
+    for (ContentionTotals* thread : registry.threads) {
+        *thread = ContentionTotals();
+    }
+}
+
+#ifdef INSTRUMENT
+#define INSTRUMENT_COUNT(counter) (thread_contention().counts[counter] += 1)
+#else
+#define INSTRUMENT_COUNT(counter) ((void)0)
+#endif
+
+/// Returns the time stamp counter. Other architectures use the steady
+/// clock in ns instead.
+uint64_t read_tsc() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+#endif
+}
+
+/// The time stamp of the last phase mark of the calling thread.
+uint64_t& phase_lap() {
+    thread_local uint64_t lap = 0;
+    return lap;
+}
+
+/// Adds the cycles since the last mark to the phase.
+void mark_phase(OperationPhase phase) {
+    uint64_t now = read_tsc();
+    uint64_t& lap = phase_lap();
+    thread_contention().phase_cycles[phase] += now - lap;
+    lap = now;
+}
+
+/// `PHASE_BEGIN` starts the timer at the beginning of an operation. Every
+/// `PHASE_MARK` then attributes the cycles since the previous mark to the
+/// given phase, so the marks are placed at the end of every phase.
+#ifdef PHASE_TIMERS
+#define PHASE_BEGIN() (phase_lap() = read_tsc())
+#define PHASE_MARK(phase) mark_phase(phase)
+#else
+#define PHASE_BEGIN() ((void)0)
+#define PHASE_MARK(phase) ((void)0)
+#endif
+
+#ifdef INSTRUMENT
+/// A `std::mutex`, which counts its acquisitions and measures the time
+/// threads wait for it and hold it.
+class InstrumentedMutex {
+public:
+    void lock() {
+        ContentionTotals& totals = thread_contention();
+        auto start = std::chrono::steady_clock::now();
+        if (!this->mutex.try_lock()) {
+            totals.counts[ContentionLockContended] += 1;
+            this->mutex.lock();
+        }
+        this->acquired = std::chrono::steady_clock::now();
+        totals.counts[ContentionLockAcquisitions] += 1;
+        totals.counts[ContentionLockWaitNs] += std::chrono::duration_cast<std::chrono::nanoseconds>(this->acquired - start).count();
+    }
+
+    bool try_lock() {
+        if (!this->mutex.try_lock()) {
+            return false;
+        }
+        this->acquired = std::chrono::steady_clock::now();
+        thread_contention().counts[ContentionLockAcquisitions] += 1;
+        return true;
+    }
+
+    void unlock() {
+        // Only the holder reads `acquired`
+        auto held = std::chrono::steady_clock::now() - this->acquired;
+        this->mutex.unlock();
+        thread_contention().counts[ContentionLockHoldNs] += std::chrono::duration_cast<std::chrono::nanoseconds>(held).count();
+    }
+
+private:
+    std::mutex mutex;
+    std::chrono::steady_clock::time_point acquired;
+};
+#else
+using InstrumentedMutex = std::mutex;
+#endif
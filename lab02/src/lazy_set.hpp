@@ -2,6 +2,7 @@
 
 #include "set.hpp"
 #include "std_set.hpp"
+#include "instrument.hpp"
 
 #include <atomic>
 #include <climits>
@@ -25,7 +26,7 @@ struct LazySetNode {
   std::atomic<bool> mark;
   std::atomic<LazySetNode *> next;
 
-  std::mutex lock;
+  InstrumentedMutex lock;
 
   /// Default constructor which sets value, mark, and next to initial values.
   LazySetNode() : value(0), mark(false), next(nullptr) {}
@@ -71,19 +72,25 @@ private:
         current = next;
         next = next->next.load();
       }
+      PHASE_MARK(PhaseTraversal);
 
       // Lock
       current->lock.lock();
       next->lock.lock();
+      PHASE_MARK(PhaseLock);
 
       // Check availability
-      if (!current->mark.load() && !next->mark.load() &&
-          current->next.load() == next) {
+      bool valid = !current->mark.load() && !next->mark.load() &&
+                   current->next.load() == next;
+      PHASE_MARK(PhaseValidation);
+      if (valid) {
         return {current, next};
       }
       // Unlock
       current->lock.unlock();
       next->lock.unlock();
+      INSTRUMENT_COUNT(ContentionLocateRetries);
+      PHASE_MARK(PhaseLock);
     }
   }
 
@@ -93,16 +100,22 @@ public:
     // A02: Add code to insert the element into the set and update `result`.
 
     // Find position of element
+    PHASE_BEGIN();
     auto [current, next] = locate(elem);
 
     if (next->value != elem) {
-      current->next.store(new LazySetNode(elem, false, next));
+      LazySetNode *node = new LazySetNode(elem, false, next);
+      PHASE_MARK(PhaseAllocation);
+      current->next.store(node);
       result = true;
     }
 
+    PHASE_MARK(PhaseLinearization);
+
     // Unlock
     current->lock.unlock();
     next->lock.unlock();
+    PHASE_MARK(PhaseLock);
     return result;
   }
 
@@ -111,6 +124,7 @@ public:
     // A02: Add code to remove the element from the set and update `result`.
 
     // Find position of element
+    PHASE_BEGIN();
     auto [current, next] = locate(elem);
 
     if (next->value == elem) {
@@ -119,9 +133,12 @@ public:
       result = true;
     }
 
+    PHASE_MARK(PhaseLinearization);
+
     // Unlock
     current->lock.unlock();
     next->lock.unlock();
+    PHASE_MARK(PhaseLock);
     return result;
   }
 
@@ -129,6 +146,7 @@ public:
     bool result = false;
     // A02: Add code to check if the element is inside the set and update
     // `result`.
+    PHASE_BEGIN();
     LazySetNode *current = head;
 
     // traverse
@@ -138,6 +156,7 @@ public:
 
     // Evaluate value
     result = !current->mark.load() && current->value == elem;
+    PHASE_MARK(PhaseTraversal);
     return result;
   }
 
@@ -0,0 +1,250 @@
+#pragma once
+
+#include "monitoring.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+/// The maximum number of operations printed, when a history is not linearizable.
+#define HISTORY_PRINT_LIMIT 32
+
+/// An operation recorded by a worker thread. Unlike an [`Event`], an entry
+/// isn't inserted at the linearization point. Instead, it records when the
+/// operation was invoked and when it returned. The linearization point lies
+/// somewhere in between.
+template<typename Op>
+struct HistoryEntry {
+    /// The performed operation.
+    Operation<Op> op;
+    /// The result of the performed operation.
+    int output;
+    /// The timestamp taken before the operation was invoked.
+    uint64_t invoke;
+    /// The timestamp taken after the operation returned.
+    uint64_t response;
+    /// The thread which performed the operation.
+    int thread_id;
+
+    void print() {
+        this->op.print();
+        std::cout << " -> " << this->output
+            << " [" << this->invoke << ", " << this->response << "] (thread " << this->thread_id << ")";
+    }
+};
+
+/// Converts a history entry into a trace record.
+template<typename Op>
+TraceRecord make_trace_record(HistoryEntry<Op>& entry) {
+    TraceRecord record = {};
+    record.invoke = entry.invoke;
+    record.response = entry.response;
+    record.argument = entry.op.argument;
+    record.output = entry.output;
+    record.thread_id = entry.thread_id;
+    record.op = entry.op.op;
+    return record;
+}
+
+/// The history of a single thread. Each worker thread writes to its own
+/// history, which means that no synchronization is required while recording.
+template<typename Op>
+using ThreadHistory = std::vector<HistoryEntry<Op>>;
+
+/// A node of the doubly linked list used by [`check_partition`]. Every
+/// entry is represented by a call and a return node.
+struct HistoryNode {
+    int entry;
+    bool is_call;
+    /// The index of the matching call or return node
+    int match;
+    int prev;
+    int next;
+};
+
+/// Checks if the given entries are linearizable with respect to the sequential
+/// specification `DS`. This uses the Wing & Gong algorithm with the state
+/// cache proposed by Lowe ("Testing for linearizability", 2017). `DS` has to
+/// be copyable and comparable with `==`.
+template<typename DS, typename Op>
+bool check_partition(std::vector<HistoryEntry<Op>*>& entries) {
+    int entry_count = entries.size();
+
+    // Sort call and return nodes by time. Calls are placed before returns
+    // with the same timestamp, since these operations might overlap.
+    std::vector<HistoryNode> nodes(2 * entry_count + 1);
+    std::vector<int> order;
+    for (int i = 0; i < entry_count; i++) {
+        nodes[2 * i + 1] = HistoryNode{i, true, 2 * i + 2, 0, 0};
+        nodes[2 * i + 2] = HistoryNode{i, false, 2 * i + 1, 0, 0};
+        order.push_back(2 * i + 1);
+        order.push_back(2 * i + 2);
+    }
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+        HistoryEntry<Op>* entry_a = entries[nodes[a].entry];
+        HistoryEntry<Op>* entry_b = entries[nodes[b].entry];
+        uint64_t time_a = nodes[a].is_call ? entry_a->invoke : entry_a->response;
+        uint64_t time_b = nodes[b].is_call ? entry_b->invoke : entry_b->response;
+        if (time_a != time_b) {
+            return time_a < time_b;
+        }
+        return nodes[a].is_call && !nodes[b].is_call;
+    });
+
+    // Node 0 is the head of the list, -1 marks the end
+    int prev = 0;
+    for (int node : order) {
+        nodes[prev].next = node;
+        nodes[node].prev = prev;
+        prev = node;
+    }
+    nodes[prev].next = -1;
+
+    auto lift = [&](int call) {
+        HistoryNode& ret = nodes[nodes[call].match];
+        nodes[nodes[call].prev].next = nodes[call].next;
+        if (nodes[call].next != -1) {
+            nodes[nodes[call].next].prev = nodes[call].prev;
+        }
+        nodes[ret.prev].next = ret.next;
+        if (ret.next != -1) {
+            nodes[ret.next].prev = ret.prev;
+        }
+    };
+    auto unlift = [&](int call) {
+        int ret = nodes[call].match;
+        nodes[nodes[ret].prev].next = ret;
+        if (nodes[ret].next != -1) {
+            nodes[nodes[ret].next].prev = ret;
+        }
+        nodes[nodes[call].prev].next = call;
+        if (nodes[call].next != -1) {
+            nodes[nodes[call].next].prev = call;
+        }
+    };
+
+    DS state;
+    std::vector<bool> linearized(entry_count, false);
+    std::unordered_map<std::vector<bool>, std::vector<DS>> cache;
+    std::vector<std::pair<int, DS>> calls;
+
+    int current = nodes[0].next;
+    while (nodes[0].next != -1) {
+        HistoryNode& node = nodes[current];
+        if (node.is_call) {
+            HistoryEntry<Op>* entry = entries[node.entry];
+            DS next_state = state;
+            int result = apply_op(&next_state, entry->op);
+
+            bool is_new = false;
+            if (result == entry->output) {
+                linearized[node.entry] = true;
+                std::vector<DS>& seen = cache[linearized];
+                is_new = std::find(seen.begin(), seen.end(), next_state) == seen.end();
+                if (is_new) {
+                    seen.push_back(next_state);
+                } else {
+                    linearized[node.entry] = false;
+                }
+            }
+
+            if (is_new) {
+                calls.push_back({current, state});
+                state = next_state;
+                lift(current);
+                current = nodes[0].next;
+            } else {
+                current = node.next;
+            }
+        } else {
+            // The oldest pending operation returned, without any valid
+            // linearization of the operations before it. Backtrack.
+            if (calls.empty()) {
+                return false;
+            }
+            int call = calls.back().first;
+            state = calls.back().second;
+            calls.pop_back();
+            linearized[nodes[call].entry] = false;
+            unlift(call);
+            current = nodes[call].next;
+        }
+    }
+
+    return true;
+}
+
+/// Returns `true` if the recorded histories are linearizable with respect
+/// to the sequential specification `DS`. The histories are partitioned by
+/// [`partition_key`] and every partition is checked on its own, this is
+/// known as P-compositionality. For sets, this means that every key is
+/// checked separately, which keeps the search space small.
+template<typename DS, typename Op>
+bool check_histories(std::vector<ThreadHistory<Op>>& histories) {
+    std::unordered_map<int, std::vector<HistoryEntry<Op>*>> partitions;
+    int entry_count = 0;
+    for (ThreadHistory<Op>& history : histories) {
+        for (HistoryEntry<Op>& entry : history) {
+            partitions[partition_key(entry.op)].push_back(&entry);
+            entry_count += 1;
+        }
+    }
+
+    for (auto& [key, entries] : partitions) {
+        if (!check_partition<DS, Op>(entries)) {
+            std::cout << "Validation failed, the history of key " << key
+                << " is not linearizable:" << std::endl;
+            std::sort(entries.begin(), entries.end(), [](HistoryEntry<Op>* a, HistoryEntry<Op>* b) {
+                return a->invoke < b->invoke;
+            });
+            for (int i = 0; i < (int)entries.size() && i < HISTORY_PRINT_LIMIT; i++) {
+                std::cout << "- ";
+                entries[i]->print();
+                std::cout << std::endl;
+            }
+            if (entries.size() > HISTORY_PRINT_LIMIT) {
+                std::cout << "- ... (" << entries.size() - HISTORY_PRINT_LIMIT << " more)" << std::endl;
+            }
+            return false;
+        }
+    }
+
+    std::cout << "Successfully validated a history of " << entry_count
+        << " operations in " << partitions.size() << " partitions" << std::endl;
+    return true;
+}
+
+/// Writes the given histories into a trace, one thread after another.
+template<typename Op>
+void write_histories(TraceWriter* trace, std::vector<ThreadHistory<Op>>& histories) {
+    for (ThreadHistory<Op>& history : histories) {
+        for (HistoryEntry<Op>& entry : history) {
+            trace->append(make_trace_record(entry));
+        }
+    }
+}
+
+/// Reads the histories of all threads from a trace, for example to check
+/// them later with [`check_histories`].
+template<typename Op>
+std::vector<ThreadHistory<Op>> read_histories(TraceReader* trace) {
+    std::vector<ThreadHistory<Op>> histories;
+    const TraceRecord* records = trace->records();
+    for (uint64_t i = 0; i < trace->size(); i++) {
+        const TraceRecord& record = records[i];
+        if ((size_t)record.thread_id >= histories.size()) {
+            histories.resize(record.thread_id + 1);
+        }
+        histories[record.thread_id].push_back(HistoryEntry<Op> {
+            Operation<Op>((Op)record.op, record.argument),
+            record.output,
+            record.invoke,
+            record.response,
+            record.thread_id
+        });
+    }
+    return histories;
+}
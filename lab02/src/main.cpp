@@ -7,14 +7,41 @@
 #include "optimistic_set.hpp"
 #include "std_multiset.hpp"
 #include "fine_multiset.hpp"
+#include "trace.hpp"
+#include "workload.hpp"
 
 #include <stdio.h>
+#include <cmath>
 #include <cstring>
+#include <functional>
 #include <iostream>
 
 #define OPERATION_COUNT 2000
 #define DEFAULT_GENERATOR_SEED 0
 #define DEFAULT_OP_MOD 128
+#define DEFAULT_CHECKER_THREADS 4
+#define DEFAULT_SAMPLE_RATE 8
+#define OVERFLOW_RING_CAPACITY 16
+#define TRACE_FILE "multiset.trace"
+#define HISTORY_TRACE_FILE "multiset_history.trace"
+
+/// Throughput drops above this percentage fail the comparison task.
+#define DEFAULT_REGRESSION_THRESHOLD 5.0
+
+/// The keys and draws of the key distribution tests.
+#define KEY_HISTOGRAM_KEYS 64
+#define KEY_HISTOGRAM_DRAWS 200000
+/// The allowed deviation from the expected frequency of a key.
+#define KEY_HISTOGRAM_TOLERANCE 0.1
+
+/// The workloads run by the workload task, if no spec files are given.
+const char* DEFAULT_WORKLOADS[] = {
+    "workloads/read_heavy.spec",
+    "workloads/write_heavy.spec",
+    "workloads/skewed.spec",
+    "workloads/open_loop.spec",
+    "workloads/steady.spec",
+};
 
 const std::vector<OpWeights<SetOperator>> DEFAULT_SET_GEN_WEIGHTS = {
     OpWeights<SetOperator> {op: SetOperator::Add, weight: 3},
@@ -29,18 +56,26 @@ const std::vector<OpWeights<MultisetOperator>> DEFAULT_MULTISET_GEN_WEIGHTS = {
 };
 
 template <typename Set>
-void run_set_n_threads(int thread_count, int op_arg_mod) {
-    StdSet test_set;
+bool run_set_n_threads(int thread_count, int op_arg_mod) {
     OpGenerator<SetOperator> generator(DEFAULT_SET_GEN_WEIGHTS, OPERATION_COUNT, op_arg_mod, DEFAULT_GENERATOR_SEED);
     Set set;
 
-    run_data_structure_n_threads<Set, SetOperator>(&set, &generator, thread_count);
+    return run_data_structure_n_threads_with_history<Set, StdSet, SetOperator>(&set, &generator, thread_count);
 }
 
 template <typename Multiset>
-bool run_multiset_n_threads(int thread_count, int op_arg_mod, int seed = DEFAULT_GENERATOR_SEED) {
+bool run_multiset_n_threads(
+    int thread_count,
+    int op_arg_mod,
+    int seed = DEFAULT_GENERATOR_SEED,
+    int checker_threads = DEFAULT_CHECKER_THREADS,
+    TraceWriter* trace = nullptr,
+    int sample_rate = 1
+) {
     StdMultiset test_set;
-    EventMonitor<Multiset, StdMultiset, MultisetOperator> monitor(&test_set);
+    MultisetMonitor monitor(&test_set, checker_threads);
+    monitor.set_trace_writer(trace);
+    monitor.set_sample_rate(sample_rate);
     OpGenerator<MultisetOperator> generator(
         DEFAULT_MULTISET_GEN_WEIGHTS,
         OPERATION_COUNT,
@@ -50,7 +85,7 @@ bool run_multiset_n_threads(int thread_count, int op_arg_mod, int seed = DEFAULT
     Multiset set(&monitor);
     monitor.set_concurrent_data_structure(&set);
 
-    return run_data_structure_n_threads_with_monitor<Multiset, StdMultiset, MultisetOperator>(
+    return run_data_structure_n_threads_with_monitor(
         &set,
         &generator,
         &monitor,
@@ -58,6 +93,63 @@ bool run_multiset_n_threads(int thread_count, int op_arg_mod, int seed = DEFAULT
     );
 }
 
+/// Records the histories of the multiset without a monitor, writes them into a
+/// trace and checks that the histories read back from the trace get the
+/// same verdict as the recorded ones.
+template <typename Multiset>
+bool test_history_trace(int thread_count, int op_arg_mod) {
+    OpGenerator<MultisetOperator> generator(DEFAULT_MULTISET_GEN_WEIGHTS, OPERATION_COUNT, op_arg_mod, DEFAULT_GENERATOR_SEED);
+    Multiset multiset;
+    std::vector<ThreadHistory<MultisetOperator>> histories = record_histories<Multiset, MultisetOperator>(&multiset, &generator, thread_count);
+    bool verdict = check_histories<StdMultiset, MultisetOperator>(histories);
+
+    TraceWriter writer(HISTORY_TRACE_FILE, trace_operator_type(MultisetOperator()));
+    if (!writer.is_open()) {
+        return false;
+    }
+    write_histories(&writer, histories);
+    writer.close();
+
+    TraceReader reader(HISTORY_TRACE_FILE);
+    if (!reader.is_valid()) {
+        return false;
+    }
+    std::vector<ThreadHistory<MultisetOperator>> read = read_histories<MultisetOperator>(&reader);
+    return check_histories<StdMultiset, MultisetOperator>(read) == verdict;
+}
+
+/// Runs the multiset without a monitor and checks the recorded histories.
+template <typename Multiset>
+bool run_multiset_n_threads_with_history(int thread_count, int op_arg_mod) {
+    OpGenerator<MultisetOperator> generator(
+        DEFAULT_MULTISET_GEN_WEIGHTS,
+        OPERATION_COUNT,
+        op_arg_mod,
+        DEFAULT_GENERATOR_SEED
+    );
+    Multiset set;
+
+    return run_data_structure_n_threads_with_history<Multiset, StdMultiset, MultisetOperator>(&set, &generator, thread_count);
+}
+
+/// Runs the multiset with a tiny monitor queue, to test the overflow policy.
+template <typename Multiset>
+bool run_multiset_with_overflow(int thread_count, int op_arg_mod, OverflowPolicy policy) {
+    StdMultiset test_set;
+    MultisetMonitor monitor(&test_set, DEFAULT_CHECKER_THREADS);
+    monitor.set_overflow_policy(policy, OVERFLOW_RING_CAPACITY);
+    OpGenerator<MultisetOperator> generator(
+        DEFAULT_MULTISET_GEN_WEIGHTS,
+        OPERATION_COUNT,
+        op_arg_mod,
+        DEFAULT_GENERATOR_SEED
+    );
+    Multiset set(&monitor);
+    monitor.set_concurrent_data_structure(&set);
+
+    return run_data_structure_n_threads_with_monitor(&set, &generator, &monitor, thread_count);
+}
+
 template <typename Set>
 bool test_final_state() {
     // A lower max number makes the console output more readable
@@ -111,9 +203,7 @@ bool test_set_implementation(char const* set_name) {
     std::cout << std::endl;
 
     std::cout << "## Running `"<< set_name <<"` with 8 thread" << std::endl;
-    run_set_n_threads<Set>(8, DEFAULT_OP_MOD);
-    std::cout << "This multithreaded test doesn't validate the state." << std::endl;
-    std::cout << "If it didn't crash it's probably fine." << std::endl;
+    valid &= run_set_n_threads<Set>(8, DEFAULT_OP_MOD);
     std::cout << std::endl;
 
     if (valid) {
@@ -162,8 +252,9 @@ int task_6() {
     std::cout << "# Task 6: `FineMultiset`" << std::endl;
 
     for (int test_run = 0; test_run < 8; test_run++) {
-        std::cout << "## Testing `FineMultiset` with 4 thread and seed: " << test_run << std::endl;
-        valid &= run_multiset_n_threads<FineMultiset>(4, DEFAULT_OP_MOD, test_run);
+        std::cout << "## Testing `FineMultiset` with 4 thread, "
+            << DEFAULT_CHECKER_THREADS << " checker threads and seed: " << test_run << std::endl;
+        valid &= run_multiset_n_threads<FineMultiset<MultisetMonitor>>(4, DEFAULT_OP_MOD, test_run);
         std::cout << std::endl;
 
         if (!valid) {
@@ -171,6 +262,215 @@ int task_6() {
         }
     }
 
+    {
+        std::cout << "## Testing `FineMultiset` with 4 thread, sampling 1/"
+            << DEFAULT_SAMPLE_RATE << " of the keys" << std::endl;
+        valid &= run_multiset_n_threads<FineMultiset<MultisetMonitor>>(
+            4,
+            DEFAULT_OP_MOD,
+            DEFAULT_GENERATOR_SEED,
+            DEFAULT_CHECKER_THREADS,
+            nullptr,
+            DEFAULT_SAMPLE_RATE
+        );
+        std::cout << std::endl;
+    }
+
+    {
+        std::cout << "## Testing `FineMultiset` with 4 thread, without a monitor" << std::endl;
+        valid &= run_multiset_n_threads_with_history<FineMultiset<>>(4, DEFAULT_OP_MOD);
+        std::cout << std::endl;
+    }
+
+    const std::pair<OverflowPolicy, char const*> policies[] = {
+        {OverflowBlock, "blocking"},
+        {OverflowSpill, "spilling"},
+        {OverflowSample, "sampling"},
+    };
+    for (auto [policy, policy_name] : policies) {
+        std::cout << "## Testing `FineMultiset` with 4 thread, " << policy_name
+            << " once " << OVERFLOW_RING_CAPACITY << " events are queued" << std::endl;
+        valid &= run_multiset_with_overflow<FineMultiset<MultisetMonitor>>(4, DEFAULT_OP_MOD, policy);
+        std::cout << std::endl;
+    }
+
+    if (valid) {
+        return 0;
+    } else {
+        return -1;
+    }
+}
+
+int task_7() {
+    std::cout << "# Task 7: Monitor benchmarking" << std::endl;
+    std::cout << std::endl;
+
+    bench::benchmark_monitor();
+
+    return 0;
+}
+
+int task_8() {
+    bool valid = true;
+    std::cout << "# Task 8: Trace recording" << std::endl;
+
+    {
+        std::cout << "## Recording `FineMultiset` with 4 thread into `" << TRACE_FILE << "`" << std::endl;
+        TraceWriter trace(TRACE_FILE, trace_operator_type(MultisetOperator()));
+        valid &= trace.is_open();
+        valid &= run_multiset_n_threads<FineMultiset<MultisetMonitor>>(
+            4,
+            DEFAULT_OP_MOD,
+            DEFAULT_GENERATOR_SEED,
+            DEFAULT_CHECKER_THREADS,
+            &trace
+        );
+        trace.close();
+        std::cout << "Recorded " << trace.size() << " events" << std::endl;
+        std::cout << std::endl;
+    }
+
+    {
+        std::cout << "## Replaying `" << TRACE_FILE << "`" << std::endl;
+        TraceReader trace(TRACE_FILE);
+        StdMultiset test_set;
+        valid &= trace.is_valid() && test_trace<StdMultiset, MultisetOperator>(&test_set, &trace);
+        if (valid) {
+            std::cout << "Successfully replayed " << trace.size() << " events" << std::endl;
+        }
+        std::cout << std::endl;
+    }
+
+    {
+        std::cout << "## Recording the history of `FineMultiset` with 4 thread into `" << HISTORY_TRACE_FILE << "`" << std::endl;
+        valid &= test_history_trace<FineMultiset<>>(4, DEFAULT_OP_MOD);
+        std::cout << std::endl;
+    }
+
+    if (valid) {
+        return 0;
+    } else {
+        return -1;
+    }
+}
+
+int task_9() {
+    std::cout << "# Task 9: Monitor overhead" << std::endl;
+    std::cout << std::endl;
+
+    bench::benchmark_monitor_overhead<FineMultiset, MultisetMonitor, StdMultiset, MultisetOperator>("FineMultiset");
+
+    return 0;
+}
+
+int task_10(int spec_count, char* specs[]) {
+    std::cout << "# Task 10: Workload benchmarking" << std::endl;
+    std::cout << std::endl;
+
+    bench::register_structure<FineSet>("FineSet");
+    bench::register_structure<OptimisticSet>("OptimisticSet");
+    bench::register_structure<LazySet>("LazySet");
+    bench::register_structure<FineMultiset<>, MultisetOperator>("FineMultiset");
+
+    std::vector<const char*> paths(specs, specs + spec_count);
+    if (paths.empty()) {
+        paths.assign(std::begin(DEFAULT_WORKLOADS), std::end(DEFAULT_WORKLOADS));
+    }
+
+    for (const char* path : paths) {
+        bench::WorkloadSpec spec;
+        if (!spec.load(path)) {
+            return -1;
+        }
+        std::cout << "## Workload `" << spec.name << "` from `" << path << "`" << std::endl;
+        if (!bench::run_workload(spec)) {
+            return -1;
+        }
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
+
+int task_11(int argc, char* argv[]) {
+    std::cout << "# Task 11: Benchmark comparison" << std::endl;
+    std::cout << std::endl;
+
+    if (argc < 2) {
+        fprintf(stderr, "Please pass the old and the new results file, and optionally a threshold in percent\n");
+        return -1;
+    }
+    double threshold = DEFAULT_REGRESSION_THRESHOLD;
+    if (argc > 2) {
+        try {
+            threshold = std::stod(argv[2]);
+        }
+        catch (const std::invalid_argument& ia) {
+            fprintf(stderr, "The threshold has to be a number\n");
+            return -1;
+        }
+    }
+
+    int regressions = bench::compare_results(argv[0], argv[1], threshold);
+    if (regressions != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/// Draws keys from the distribution and checks that every key is drawn with
+/// the frequency returned by `expected`.
+bool test_key_histogram(KeyDistribution distribution, std::function<double(int)> expected) {
+    std::vector<OpWeights<SetOperator>> weights = {
+        OpWeights<SetOperator> {op: SetOperator::Contains, weight: 1},
+    };
+    OpGenerator<SetOperator> generator(
+        weights,
+        KEY_HISTOGRAM_DRAWS,
+        KEY_HISTOGRAM_KEYS,
+        DEFAULT_GENERATOR_SEED,
+        distribution
+    );
+    std::vector<int> counts(KEY_HISTOGRAM_KEYS, 0);
+    OpStream<SetOperator> stream = generator.stream(0);
+    while (auto operation = stream.next()) {
+        counts[operation.value().argument] += 1;
+    }
+
+    for (int key = 0; key < KEY_HISTOGRAM_KEYS; key++) {
+        double frequency = (double)counts[key] / KEY_HISTOGRAM_DRAWS;
+        if (std::abs(frequency - expected(key)) > KEY_HISTOGRAM_TOLERANCE * expected(key)) {
+            std::cout << "Key " << key << " was drawn with a frequency of " << frequency
+                << " instead of " << expected(key) << std::endl;
+            return false;
+        }
+    }
+    std::cout << "Successfully drew " << KEY_HISTOGRAM_DRAWS << " keys" << std::endl;
+    return true;
+}
+
+int task_12() {
+    bool valid = true;
+    std::cout << "# Task 12: Key distributions" << std::endl;
+    std::cout << std::endl;
+
+    double n = KEY_HISTOGRAM_KEYS;
+    {
+        std::cout << "## Drawing `hotspot(0.25, 0.8)`" << std::endl;
+        valid &= test_key_histogram(KeyDistribution::hotspot(0.25, 0.8), [&](int key) {
+            return key < n * 0.25 ? 0.8 / (n * 0.25) : 0.2 / (n * 0.75);
+        });
+        std::cout << std::endl;
+    }
+
+    {
+        std::cout << "## Drawing `hotspot(1.0, 0.8)`, where every key is hot" << std::endl;
+        valid &= test_key_histogram(KeyDistribution::hotspot(1.0, 0.8), [&](int) {
+            return 1.0 / n;
+        });
+        std::cout << std::endl;
+    }
+
     if (valid) {
         return 0;
     } else {
@@ -206,6 +506,18 @@ int main(int argc, char* argv[]) {
             return task_4();
         case 6:
             return task_6();
+        case 7:
+            return task_7();
+        case 8:
+            return task_8();
+        case 9:
+            return task_9();
+        case 10:
+            return task_10(argc - 2, argv + 2);
+        case 11:
+            return task_11(argc - 2, argv + 2);
+        case 12:
+            return task_12();
         default:
             fprintf(stderr, "Please enter a valid task, as the first argument\n");
             return -1;
@@ -6,12 +6,38 @@
 #include <mutex>
 #include <chrono>
 #include <thread>
+#include <algorithm>
 #include <atomic>
+#include <cmath>
+#include <string>
+#include <condition_variable>
+#include <cstdio>
+#include <vector>
 
 #include "set.hpp"
+#include "trace.hpp"
 
-#define DEQUE_SLEEP_DELAY 50
-#define INCOMPLETE_EVENT_SLEEP_DELAY 10
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/// The number of queued events, after which a waiting monitor is woken up.
+#define MONITOR_BATCH_SIZE 64
+/// The number of times an incomplete event is polled before the monitor sleeps.
+#define INCOMPLETE_EVENT_SPIN_COUNT 1000
+/// The time in microseconds, after which an incomplete event is assumed
+/// to never be completed.
+#define INCOMPLETE_EVENT_TIMEOUT 1000000
+/// The number of events allocated at once by an [`EventSlab`].
+#define EVENT_SLAB_SIZE 1024
+/// The default capacity of the [`EventRing`] of a monitor.
+#define MONITOR_RING_CAPACITY 65536
+/// The sample rate, which the `OverflowSample` policy switches to.
+#define MONITOR_OVERFLOW_SAMPLE_RATE 64
+/// The default file for events spilled by the `OverflowSpill` policy.
+#define MONITOR_SPILL_FILE "monitor.spill"
 
 enum SetOperator {
     Add = 1,
@@ -96,6 +122,44 @@ int apply_op(Multiset* set, Operation<MultisetOperator>& op) {
     }
 }
 
+/// Returns the key that an operation depends on. Operations with different
+/// keys are independent of each other, which allows them to be validated
+/// separately. Set and multiset operations only depend on their argument.
+int partition_key(Operation<SetOperator>& op) {
+    return op.argument;
+}
+
+int partition_key(Operation<MultisetOperator>& op) {
+    return op.argument;
+}
+
+/// Indicates if operations with different [`partition_key`]s are independent.
+template<typename Op>
+struct IsPartitioned {
+    static const bool value = true;
+};
+
+/// Mixes the bits of a partition key. The sample of a sampling monitor is
+/// selected by this hash, which spreads it evenly over consecutive keys.
+uint32_t key_hash(int key) {
+    uint32_t hash = key;
+    hash ^= hash >> 16;
+    hash *= 0x7feb352d;
+    hash ^= hash >> 15;
+    hash *= 0x846ca68b;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+/// Identifies the operator enum of a trace file, see [`TraceHeader`].
+uint32_t trace_operator_type(SetOperator op) {
+    return 1;
+}
+
+uint32_t trace_operator_type(MultisetOperator op) {
+    return 2;
+}
+
 /// A struct defining the weigh of an operator for the [`OpGenerator`] class.
 template<typename Op>
 struct OpWeights {
@@ -105,79 +169,427 @@ struct OpWeights {
     int weight;
 };
 
+/// The increment of SplitMix64, an odd approximation of 2^64 / phi.
+const uint64_t SPLITMIX_GAMMA = 0x9e3779b97f4a7c15;
+
+/// The output function of SplitMix64, which maps a counter to a random value.
+uint64_t splitmix64(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+}
+
+/// Returns `true` if the operator inserts its argument. This is used by
+/// the `KeyLatest` distribution.
+bool is_insert(SetOperator op) {
+    return op == SetOperator::Add;
+}
+
+bool is_insert(MultisetOperator op) {
+    return op == MultisetOperator::MSetAdd;
+}
+
+/// The shape of the arguments drawn by an [`OpGenerator`].
+enum KeyDistributionType {
+    /// Every key is equally likely.
+    KeyUniform = 1,
+    /// Key `i` is drawn with a probability proportional to `1 / (i + 1)^theta`.
+    KeyZipfian = 2,
+    /// A fraction of the operations uses the first keys, the hot set.
+    KeyHotspot = 3,
+    /// Every thread walks through the keys in order, starting at its own offset.
+    KeySequential = 4,
+    /// Inserts use sequential keys, other operations prefer keys which were
+    /// inserted recently by the same thread. The distance to the latest key
+    /// is Zipfian.
+    KeyLatest = 5,
+};
+
+/// Describes how an [`OpGenerator`] draws the arguments in `[0, argument_modulo)`.
+struct KeyDistribution {
+    KeyDistributionType type = KeyUniform;
+    /// The skew of `KeyZipfian` and `KeyLatest`, in `(0, 1)`.
+    double theta = 0.99;
+    /// The fraction of the keys in the hot set of `KeyHotspot`.
+    double hot_set = 0.2;
+    /// The fraction of the operations, which use a key of the hot set.
+    double hot_ops = 0.8;
+
+    static KeyDistribution uniform() {
+        return KeyDistribution();
+    }
+
+    static KeyDistribution zipfian(double theta = 0.99) {
+        KeyDistribution distribution;
+        distribution.type = KeyZipfian;
+        distribution.theta = theta;
+        return distribution;
+    }
+
+    static KeyDistribution hotspot(double hot_set = 0.2, double hot_ops = 0.8) {
+        KeyDistribution distribution;
+        distribution.type = KeyHotspot;
+        distribution.hot_set = hot_set;
+        distribution.hot_ops = hot_ops;
+        return distribution;
+    }
+
+    static KeyDistribution sequential() {
+        KeyDistribution distribution;
+        distribution.type = KeySequential;
+        return distribution;
+    }
+
+    static KeyDistribution latest(double theta = 0.99) {
+        KeyDistribution distribution;
+        distribution.type = KeyLatest;
+        distribution.theta = theta;
+        return distribution;
+    }
+
+    /// A short description for benchmark tables.
+    std::string name() {
+        char buffer[32];
+        switch (this->type) {
+            case KeyZipfian:
+                snprintf(buffer, sizeof(buffer), "zipf(%.2f)", this->theta);
+                break;
+            case KeyHotspot:
+                snprintf(buffer, sizeof(buffer), "hot(%d/%d)", (int)(this->hot_set * 100), (int)(this->hot_ops * 100));
+                break;
+            case KeySequential:
+                snprintf(buffer, sizeof(buffer), "sequential");
+                break;
+            case KeyLatest:
+                snprintf(buffer, sizeof(buffer), "latest(%.2f)", this->theta);
+                break;
+            default:
+                snprintf(buffer, sizeof(buffer), "uniform");
+                break;
+        }
+        return buffer;
+    }
+};
+
+/// Maps uniform values to ranks in `[0, n)` with a Zipfian distribution, where
+/// rank 0 is the most likely. This uses the method by Gray et al. ("Quickly
+/// generating billion-record synthetic databases", 1994), which is also used
+/// by YCSB. The constants are computed once in `O(n)`.
+struct ZipfianRanks {
+    int n = 1;
+    double theta = 0.99;
+    double alpha = 0;
+    double zetan = 1;
+    double eta = 0;
+
+    ZipfianRanks() {}
+
+    ZipfianRanks(int n, double theta) :
+        n(n),
+        theta(theta)
+    {
+        this->zetan = 0;
+        for (int i = 1; i <= n; i++) {
+            this->zetan += 1.0 / pow(i, theta);
+        }
+        double zeta2 = 1.0 + 1.0 / pow(2, theta);
+        this->alpha = 1.0 / (1.0 - theta);
+        this->eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / this->zetan);
+    }
+
+    /// Returns the rank for a uniform value `u` in `[0, 1)`.
+    int rank(double u) {
+        double uz = u * this->zetan;
+        if (uz < 1.0) {
+            return 0;
+        }
+        if (uz < 1.0 + pow(0.5, this->theta)) {
+            return std::min(1, this->n - 1);
+        }
+        int rank = this->n * pow(this->eta * u - this->eta + 1.0, this->alpha);
+        return std::min(rank, this->n - 1);
+    }
+};
+
+template<typename Op>
+class OpStream;
+
+/// Describes the operations of a test or benchmark run. The operations are
+/// generated by one [`OpStream`] per thread, see [`OpGenerator::stream`].
 template<typename Op>
 class OpGenerator {
     int target_op_count;
-    /// The amount of operations, which have been generated. This is an atomic
-    /// integer, to share the count across all threads.
-    std::atomic_int counter;
     /// The weight of the operators, that can be generated.
     std::vector<OpWeights<Op>> weights;
     /// The total weight used as a modulo during generation.
     int total_weight;
     /// A modulo applied to the number generated as the argument for the operations.
     int argument_modulo;
-    /// A lock around consecutive `rand()` calls, to make sure they
-    /// generate the same pair of values.
-    std::mutex rand_lock;
     int seed;
+    KeyDistribution distribution;
+    /// Only used by `KeyZipfian` and `KeyLatest`.
+    ZipfianRanks zipfian;
+
+    friend class OpStream<Op>;
 
 public:
     OpGenerator(
         std::vector<OpWeights<Op>> weights,
         int target_op_count,
         int argument_modulo,
-        int seed
+        int seed,
+        KeyDistribution distribution = KeyDistribution::uniform()
     ) :
         target_op_count(target_op_count),
         weights(weights),
         argument_modulo(argument_modulo),
-        seed(seed)
+        seed(seed),
+        distribution(distribution)
     {
         total_weight = 0;
         for (int i = 0; i < (int)this->weights.size(); i++) {
             total_weight += this->weights[i].weight;
         }
 
-        this->reset();
+        if (distribution.type == KeyZipfian || distribution.type == KeyLatest) {
+            this->zipfian = ZipfianRanks(argument_modulo, distribution.theta);
+        }
+    }
+
+    /// Returns the stream of the given thread. The operations are split
+    /// evenly between `thread_count` streams. A stream only depends on the
+    /// seed and the thread id, which makes every run reproducible.
+    OpStream<Op> stream(int thread_id, int thread_count = 1) {
+        int count = this->target_op_count / thread_count;
+        if (thread_id < this->target_op_count % thread_count) {
+            count += 1;
+        }
+        return OpStream<Op>(this, thread_id, thread_count, count);
     }
+};
+
+/// The operations of a single thread. The stream uses a counter-based
+/// SplitMix64 generator: the n-th random value is computed from the stream
+/// key and n alone. Streams therefore don't share any state.
+template<typename Op>
+class OpStream {
+    OpGenerator<Op>* generator;
+    uint64_t key;
+    /// Every stream uses its own odd increment, to keep the streams apart.
+    uint64_t gamma;
+    uint64_t counter = 0;
+    int remaining;
+    /// The first key of `KeySequential` and `KeyLatest`. The streams start
+    /// at different offsets, to spread the threads over the key range.
+    int offset;
+    /// The number of sequential keys used by this stream.
+    int sequence = 0;
+    /// The last key inserted by this stream, used by `KeyLatest`.
+    int latest;
+
+    /// Draws an argument for the operator from the uniform value `random`.
+    int next_argument(Op op, uint32_t random) {
+        KeyDistribution& distribution = this->generator->distribution;
+        int n = this->generator->argument_modulo;
+        double u = random / 4294967296.0;
 
-    void reset() {
-        this->counter = 0;
-        srand(this->seed);
+        switch (distribution.type) {
+            case KeyZipfian:
+                return this->generator->zipfian.rank(u);
+            case KeyHotspot: {
+                int hot_count = std::max(1, std::min(n, (int)(distribution.hot_set * n)));
+                if (hot_count == n) {
+                    // Every key is hot, which makes the distribution uniform
+                    return random % n;
+                }
+                if (u < distribution.hot_ops) {
+                    return std::min((int)(u / distribution.hot_ops * hot_count), hot_count - 1);
+                }
+                double cold = (u - distribution.hot_ops) / (1.0 - distribution.hot_ops);
+                return std::min(hot_count + (int)(cold * (n - hot_count)), n - 1);
+            }
+            case KeySequential:
+                return (this->offset + this->sequence++) % n;
+            case KeyLatest:
+                if (is_insert(op)) {
+                    this->latest = (this->offset + this->sequence++) % n;
+                    return this->latest;
+                }
+                return ((this->latest - this->generator->zipfian.rank(u)) % n + n) % n;
+            default:
+                return random % n;
+        }
+    }
+
+public:
+    OpStream(OpGenerator<Op>* generator, int stream_id, int stream_count, int count) :
+        generator(generator),
+        remaining(count)
+    {
+        uint64_t base = splitmix64((uint64_t)generator->seed);
+        this->key = splitmix64(base + (stream_id + 1) * SPLITMIX_GAMMA);
+        this->gamma = splitmix64(this->key) | 1;
+        this->offset = (int64_t)stream_id * generator->argument_modulo / stream_count;
+        this->latest = this->offset;
     }
 
     std::optional<Operation<Op>> next() {
-        if (this->counter.fetch_add(1) >= target_op_count) {
+        if (this->remaining == 0) {
             return std::nullopt;
         }
+        this->remaining -= 1;
 
-        // Rand generation
-        this->rand_lock.lock();
-        int op_selection = rand() % this->total_weight;
-        int argument = rand() % argument_modulo;
-        this->rand_lock.unlock();
+        // The upper half selects the operator, the lower half the argument
+        uint64_t random = splitmix64(this->key + this->counter * this->gamma);
+        this->counter += 1;
+        int op_selection = (random >> 32) % this->generator->total_weight;
 
         // Select operator
         int weight_index = 0;
-        while (op_selection > this->weights[weight_index].weight) {
-            op_selection -= this->weights[weight_index].weight;
+        while (op_selection >= this->generator->weights[weight_index].weight) {
+            op_selection -= this->generator->weights[weight_index].weight;
             weight_index += 1;
         }
-        Op op = this->weights[weight_index].op;
+        Op op = this->generator->weights[weight_index].op;
+
+        return Operation<Op>(op, this->next_argument(op, (uint32_t)random));
+    }
 
-        return Operation<Op>(op, argument);
+    /// Returns the number of operations left in the stream.
+    int size() {
+        return this->remaining;
     }
 };
 
+/// The operations of a single thread, generated before a benchmark run. The
+/// operators and arguments are stored in two arrays, which the worker reads
+/// sequentially. This keeps the generation out of the measured time.
+template<typename Op>
+struct OpTape {
+    std::vector<Op> ops;
+    std::vector<int> arguments;
+
+    OpTape(OpStream<Op> stream) {
+        this->ops.reserve(stream.size());
+        this->arguments.reserve(stream.size());
+        while (auto maybe_operation = stream.next()) {
+            this->ops.push_back(maybe_operation->op);
+            this->arguments.push_back(maybe_operation->argument);
+        }
+    }
+
+    size_t size() {
+        return this->ops.size();
+    }
+};
+
+/// Records the streams of all threads of a generator into tapes.
+template<typename Op>
+std::vector<OpTape<Op>> record_tapes(OpGenerator<Op>* generator, int thread_count) {
+    std::vector<OpTape<Op>> tapes;
+    for (int thread_id = 0; thread_id < thread_count; thread_id++) {
+        tapes.push_back(OpTape<Op>(generator->stream(thread_id, thread_count)));
+    }
+    return tapes;
+}
+
+/// Blocks the calling thread as long as `*word == expected`, but at most for
+/// `timeout` microseconds. A `timeout` of 0 waits without a time limit. The
+/// function can return spuriously, callers should check their condition again.
+void futex_wait(std::atomic<uint32_t>* word, uint32_t expected, long timeout = 0) {
+#ifdef __linux__
+    struct timespec time_limit;
+    time_limit.tv_sec = timeout / 1000000;
+    time_limit.tv_nsec = (timeout % 1000000) * 1000;
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, expected, timeout ? &time_limit : nullptr, nullptr, 0);
+#else
+    if (timeout == 0) {
+        word->wait(expected);
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(std::min(timeout, 10L)));
+    }
+#endif
+}
+
+/// Wakes all threads blocked in [`futex_wait`] on the given word.
+void futex_wake(std::atomic<uint32_t>* word) {
+#ifdef __linux__
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#else
+    word->notify_all();
+#endif
+}
+
+/// Allows a consumer thread to sleep until a producer has new work for it.
+/// Producers only pay for a wakeup, if the consumer is actually sleeping.
+///
+/// The consumer has to call `prepare()`, then check if there is any work
+/// and only then call `wait()`. This order ensures that no wakeup is lost.
+struct WakeSignal {
+    std::atomic<uint32_t> sequence = 0;
+    std::atomic<bool> sleeping = false;
+
+    uint32_t prepare() {
+        this->sleeping = true;
+        return this->sequence.load();
+    }
+
+    void wait(uint32_t sequence) {
+        futex_wait(&this->sequence, sequence);
+        this->sleeping = false;
+    }
+
+    void cancel() {
+        this->sleeping = false;
+    }
+
+    void notify() {
+        if (this->sleeping) {
+            this->sequence.fetch_add(1);
+            futex_wake(&this->sequence);
+        }
+    }
+};
+
+/// Returns a timestamp in nanoseconds. The clock is monotonic and shared
+/// by all threads, which makes timestamps of different threads comparable.
+uint64_t history_clock() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+}
+
+/// Returns a small number, which identifies the calling thread in traces.
+int current_thread_id() {
+    static std::atomic<int> next_thread_id = 0;
+    thread_local int thread_id = next_thread_id.fetch_add(1);
+    return thread_id;
+}
+
+template<typename Op>
+struct EventSlab;
+
 template<typename Op>
 struct Event {
     /// The operator that this event used.
     Operation<Op> op;
     /// The result of the performed operation.
     int output;
-    /// Indicates if this event is complete and can be validated.
-    bool is_complete;
+    /// Indicates if this event is complete and can be validated. This is a
+    /// 32 bit word, to allow the monitor to wait on it with [`futex_wait`].
+    std::atomic<uint32_t> is_complete;
+    /// Set by the monitor, when it waits for this event to be completed.
+    std::atomic<bool> has_waiter = false;
+    /// The slab this event was allocated from, or `nullptr` if the event
+    /// was allocated with `new`.
+    EventSlab<Op>* slab = nullptr;
+    /// The next event in the free list of the slab.
+    Event<Op>* next_free = nullptr;
+    /// The time just before the event was inserted into the sequence, only
+    /// set if the monitor records a trace.
+    uint64_t timestamp = 0;
+    /// The thread which performed the operation, only set if the monitor records a trace.
+    int thread_id = 0;
 
     Event(Op op, int arg, int output) :
         op(op, arg),
@@ -192,12 +604,46 @@ struct Event {
         is_complete(false)
     {}
 
+    Event(const Event& other) :
+        op(other.op),
+        output(other.output),
+        is_complete(other.is_complete.load()),
+        timestamp(other.timestamp),
+        thread_id(other.thread_id)
+    {}
+
     /// This allows to store/update the result of an event. It can be used with
     /// `monitor->reserve` to store an event in the linearized sequence, and
     /// later update the result of the operation.
     void complete(int output) {
         this->output = output;
         this->is_complete = true;
+        if (this->has_waiter) {
+            futex_wake(&this->is_complete);
+        }
+    }
+
+    /// Waits until the event is completed. Returns `false` if this didn't
+    /// happen within `INCOMPLETE_EVENT_TIMEOUT`.
+    bool wait_complete() {
+        for (int i = 0; i < INCOMPLETE_EVENT_SPIN_COUNT; i++) {
+            if (this->is_complete) {
+                return true;
+            }
+        }
+
+        this->has_waiter = true;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(INCOMPLETE_EVENT_TIMEOUT);
+        while (!this->is_complete) {
+            long remaining = std::chrono::duration_cast<std::chrono::microseconds>(
+                deadline - std::chrono::steady_clock::now()
+            ).count();
+            if (remaining <= 0) {
+                return false;
+            }
+            futex_wait(&this->is_complete, false, remaining);
+        }
+        return true;
     }
 
     void print() {
@@ -206,6 +652,82 @@ struct Event {
     }
 };
 typedef Event<SetOperator> SetEvent;
+
+/// A slab hands out events to a single producer thread. Events are allocated
+/// in chunks of `EVENT_SLAB_SIZE` and are returned to the slab, once they have
+/// been validated. This avoids freeing memory on the monitor thread, which
+/// was allocated on a producer thread.
+///
+/// Only the owning thread allocates events. Events are returned with a
+/// lock-free push onto `returned`, which the owner takes over as a whole,
+/// once its own free list is empty.
+template<typename Op>
+struct EventSlab {
+    /// Free events, only accessed by the owning thread.
+    Event<Op>* free_list = nullptr;
+    /// Events returned by the monitor, which the owner hasn't taken yet.
+    std::atomic<Event<Op>*> returned = nullptr;
+    std::vector<Event<Op>*> chunks;
+    /// The number of events used from the last chunk.
+    int chunk_used = EVENT_SLAB_SIZE;
+
+    ~EventSlab() {
+        for (Event<Op>* chunk : this->chunks) {
+            ::operator delete(chunk);
+        }
+    }
+
+    /// Copies the given event into a slot of this slab.
+    Event<Op>* allocate(Event<Op>& event) {
+        if (this->free_list == nullptr) {
+            this->free_list = this->returned.exchange(nullptr);
+        }
+
+        void* slot;
+        if (this->free_list != nullptr) {
+            slot = this->free_list;
+            this->free_list = this->free_list->next_free;
+        } else {
+            if (this->chunk_used == EVENT_SLAB_SIZE) {
+                this->chunks.push_back((Event<Op>*)::operator new(sizeof(Event<Op>) * EVENT_SLAB_SIZE));
+                this->chunk_used = 0;
+            }
+            slot = &this->chunks.back()[this->chunk_used];
+            this->chunk_used += 1;
+        }
+
+        Event<Op>* slab_event = new (slot) Event<Op>(event);
+        slab_event->slab = this;
+        return slab_event;
+    }
+
+    /// Returns an event to this slab. This can be called from any thread.
+    void recycle(Event<Op>* event) {
+        Event<Op>* head = this->returned.load();
+        do {
+            event->next_free = head;
+        } while (!this->returned.compare_exchange_weak(head, event));
+    }
+};
+
+/// Returns an event of the calling thread, which isn't part of any sequence.
+/// This is returned by `monitor->reserve` for operations which aren't
+/// monitored, completing it has no effect.
+template<typename Op>
+Event<Op>* scratch_event() {
+    thread_local Event<Op> scratch(Op(), 0, 0);
+    return &scratch;
+}
+
+/// Frees an event, which has been inserted with `monitor->reserve`.
+template<typename Op>
+void release_event(Event<Op>* event) {
+    if (event->slab) {
+        event->slab->recycle(event);
+    } else {
+        delete event;
+    }
+}
 typedef Event<MultisetOperator> MultisetEvent;
 
 /// Returns `true` if the given event can be successfully applied to the given data structure
@@ -229,17 +751,12 @@ bool test_event(DS* data_structure, Event<Op>* event) {
 template<typename DS, typename Op>
 bool test_events(DS* data_structure, std::queue<Event<Op>*>* events, bool verbose = false) {
     while (!events->empty()) {
-        int loop_counter = 0;
-        while (!events->front()->is_complete) {
-            loop_counter += 1;
-            // After 1 seconds of waiting, it's safe to assume that the event was never marked as completed.
-            if (loop_counter >= std::chrono::microseconds(std::chrono::seconds(1)).count() / INCOMPLETE_EVENT_SLEEP_DELAY) {
-                std::cout << "Validation failed current event `";
-                events->front()->print();
-                std::cout << "` was never marked as completed" << std::endl;
-                return false;
-            }
-            std::this_thread::sleep_for(std::chrono::microseconds(INCOMPLETE_EVENT_SLEEP_DELAY));
+        // After 1 seconds of waiting, it's safe to assume that the event was never marked as completed.
+        if (!events->front()->wait_complete()) {
+            std::cout << "Validation failed current event `";
+            events->front()->print();
+            std::cout << "` was never marked as completed" << std::endl;
+            return false;
         }
 
         if (!test_event(data_structure, events->front())) {
@@ -253,23 +770,222 @@ bool test_events(DS* data_structure, std::queue<Event<Op>*>* events, bool verbos
             std::cout << std::endl;
         }
 
-        delete events->front();
+        release_event(events->front());
         events->pop();
     }
 
     return true;
 }
 
+/// Converts a completed event into a trace record. The monitor only knows a
+/// single point in time of every event, which is used as both the invoke
+/// and the response. Monitor traces are therefore no interval histories and
+/// can't be checked with [`check_histories`]. Their records are in the order
+/// of the sequence, which [`test_trace`] validates.
+template<typename Op>
+TraceRecord make_trace_record(Event<Op>* event) {
+    TraceRecord record = {};
+    record.invoke = event->timestamp;
+    record.response = event->timestamp;
+    record.argument = event->op.argument;
+    record.output = event->output;
+    record.thread_id = event->thread_id;
+    record.op = event->op.op;
+    return record;
+}
+
+/// Returns `true` if the events of the given trace can be successfully
+/// applied to the given data structure. The records are validated in the
+/// order of the trace, directly from the memory mapped file.
+template<typename DS, typename Op>
+bool test_trace(DS* data_structure, TraceReader* trace, bool verbose = false) {
+    if (trace->operator_type() != trace_operator_type(Op())) {
+        std::cout << "The trace contains operations of another data type" << std::endl;
+        return false;
+    }
+
+    const TraceRecord* records = trace->records();
+    for (uint64_t i = 0; i < trace->size(); i++) {
+        Event<Op> event((Op)records[i].op, records[i].argument, records[i].output);
+        if (!test_event(data_structure, &event)) {
+            std::cout << "Validation failed after " << i << " events of the trace" << std::endl;
+            return false;
+        }
+
+        if (verbose) {
+            std::cout << "- ";
+            event.print();
+            std::cout << std::endl;
+        }
+    }
+
+    return true;
+}
+
+/// A bounded FIFO queue of events, which were added but not yet taken by
+/// the monitor. The ring is protected by the lock of the monitor.
+template<typename Op>
+struct EventRing {
+    std::vector<Event<Op>*> slots;
+    /// The number of events taken from the ring.
+    uint64_t head = 0;
+    /// The number of events pushed into the ring.
+    uint64_t tail = 0;
+    /// The time, at which the oldest event in the ring was pushed.
+    uint64_t oldest_time = 0;
+
+    EventRing(size_t capacity) : slots(capacity) {}
+
+    size_t capacity() {
+        return this->slots.size();
+    }
+
+    size_t size() {
+        return this->tail - this->head;
+    }
+
+    bool is_full() {
+        return this->size() == this->capacity();
+    }
+
+    void push(Event<Op>* event) {
+        if (this->size() == 0) {
+            this->oldest_time = history_clock();
+        }
+        this->slots[this->tail % this->capacity()] = event;
+        this->tail += 1;
+    }
+
+    /// Moves all events of the ring into the given queue.
+    void drain(std::queue<Event<Op>*>* events) {
+        while (this->head != this->tail) {
+            events->push(this->slots[this->head % this->capacity()]);
+            this->head += 1;
+        }
+    }
+
+    /// Changes the capacity, this is only allowed while the ring is empty.
+    void resize(size_t capacity) {
+        this->slots.assign(capacity, nullptr);
+        this->head = 0;
+        this->tail = 0;
+    }
+};
+
+/// Determines what a producer does, when the [`EventRing`] of the monitor is full.
+enum OverflowPolicy {
+    /// The producer waits until the monitor has taken the queued events.
+    OverflowBlock = 1,
+    /// The monitor stops validating and writes all further events into a
+    /// trace file, which is validated once the run is finished. Producers
+    /// only wait until the monitor has written the queued events.
+    OverflowSpill = 2,
+    /// The monitor switches to sampling `MONITOR_OVERFLOW_SAMPLE_RATE` of
+    /// the keys. Events of other keys are dropped, other producers wait.
+    /// Operators which aren't partitioned block instead.
+    OverflowSample = 3,
+};
+
+/// Queue statistics of an [`EventMonitor`], reported at the end of a run.
+/// The lag of a batch is the time from queuing its oldest event, until the
+/// batch was validated or handed to the checkers.
+struct MonitorStats {
+    uint64_t batches = 0;
+    uint64_t depth_sum = 0;
+    uint64_t max_depth = 0;
+    uint64_t lag_sum = 0;
+    uint64_t max_lag = 0;
+    /// The number of times a producer found the ring full.
+    uint64_t overflows = 0;
+
+    void add_batch(uint64_t depth, uint64_t lag) {
+        this->batches += 1;
+        this->depth_sum += depth;
+        this->max_depth = std::max(this->max_depth, depth);
+        this->lag_sum += lag;
+        this->max_lag = std::max(this->max_lag, lag);
+    }
+
+    void print(size_t capacity) {
+        if (this->batches == 0) {
+            return;
+        }
+        printf(
+            "Monitor queue: %lu batches, depth mean %.1f max %lu of %lu, lag mean %.3f ms max %.3f ms, %lu overflows\n",
+            this->batches,
+            (double)this->depth_sum / this->batches,
+            this->max_depth,
+            capacity,
+            this->lag_sum / 1000000.0 / this->batches,
+            this->max_lag / 1000000.0,
+            this->overflows
+        );
+    }
+};
+
+/// A checker validates the events of one shard against its own copy of the
+/// sequential data structure. See [`EventMonitor::monitor`].
+template<typename DS, typename Op>
+struct EventChecker {
+    DS* data_structure;
+    /// The events dispatched to this checker, which haven't been validated yet.
+    std::queue<Event<Op>*> events_to_test;
+    std::mutex lock;
+    std::thread thread;
+    /// Wakes the checker, once events have been dispatched to it.
+    WakeSignal signal;
+    /// The number of events validated by this checker.
+    uint64_t event_count = 0;
+};
+
 /// This class uses coarse grained locking, because this is the simplest thing
 /// to implement. During the course you'll learn about more efficient algorithms
 /// for concurrent data structures.
+///
+/// The validation can be distributed over several checker threads. Events
+/// with different [`partition_key`]s are independent, the monitor therefore
+/// assigns every key to one checker and only keeps the order of events with
+/// the same key. Every checker uses its own sequential data structure.
+///
+/// Producers queue their events in a bounded [`EventRing`]. If the monitor
+/// falls behind and the ring fills up, the [`OverflowPolicy`] decides if
+/// producers wait, or if the events are spilled to disk or sampled.
 template<typename CAS, typename DS, typename Op>
 class EventMonitor {
 public:
-    EventMonitor(DS* data_structure) :
-        data_structure(data_structure),
+    /// Data structures can skip any work, which is only done for the monitor,
+    /// if this is `false`. See [`NullMonitor`].
+    static constexpr bool enabled = true;
+
+    EventMonitor(DS* data_structure, int checker_threads = 1) :
+        id(next_monitor_id.fetch_add(1)),
+        ring(MONITOR_RING_CAPACITY),
         concurrent_data_structure(nullptr)
     {
+        // Operations which share a single key can't be distributed
+        if (!IsPartitioned<Op>::value) {
+            checker_threads = 1;
+        }
+
+        for (int i = 0; i < checker_threads; i++) {
+            EventChecker<DS, Op>* checker = new EventChecker<DS, Op>();
+            checker->data_structure = (i == 0) ? data_structure : new DS();
+            this->checkers.push_back(checker);
+        }
+    }
+
+    ~EventMonitor() {
+        for (int i = 0; i < (int)this->checkers.size(); i++) {
+            if (i != 0) {
+                delete this->checkers[i]->data_structure;
+            }
+            delete this->checkers[i];
+        }
+        // This also frees all events, which haven't been validated
+        for (EventSlab<Op>* slab : this->slabs) {
+            delete slab;
+        }
+        delete this->spill;
     }
 
     void add(Event<Op> event) {
@@ -282,22 +998,50 @@ public:
     /// at the linearization point when the result of the operation 
     /// is still unknown.
     Event<Op>* reserve(Event<Op> event) {
-        // Copy the event to an event on the heap. This allows us to return the
-        // pointer for later modification.
-        Event<Op>* seq_event = new Event(event);
+        if (!this->is_sampled(event.op)) {
+            return scratch_event<Op>();
+        }
+
+        // Copy the event into the slab of this thread. This allows us to
+        // return the pointer for later modification.
+        Event<Op>* seq_event = this->local_slab()->allocate(event);
+
+        // Read outside of the lock, to keep the serialized section short
+        if (this->trace) {
+            seq_event->timestamp = history_clock();
+            seq_event->thread_id = current_thread_id();
+        }
 
         this->lock.lock(); // Linearization point (For anyone that is interested)
-        this->events_to_test.push(seq_event);
+        if (this->ring.is_full() && !this->make_room(seq_event)) {
+            this->lock.unlock();
+            release_event(seq_event);
+            return scratch_event<Op>();
+        }
+        this->ring.push(seq_event);
+        bool batch_ready = this->ring.size() == MONITOR_BATCH_SIZE;
         this->lock.unlock();
 
+        if (batch_ready) {
+            this->signal.notify();
+        }
+
         return seq_event;
     }
 
     void finish() {
         this->stop = true;
+        this->signal.notify();
     }
 
     bool monitor() {
+        // With a single checker, the events are validated on this thread
+        if (this->checkers.size() > 1) {
+            for (EventChecker<DS, Op>* checker : this->checkers) {
+                checker->thread = std::thread(&EventMonitor::checker_thread_func, this, checker);
+            }
+        }
+
         bool running = true;
         while (running) {
             // `running` and `this->finish` are separate flags, to ensure that
@@ -308,32 +1052,89 @@ public:
 
             std::queue<Event<Op>*> events_to_test;
             this->lock.lock(); // Linearization point
-            this->events_to_test.swap(events_to_test);
+            uint64_t oldest_time = this->ring.oldest_time;
+            this->ring.drain(&events_to_test);
+            bool spilling = this->spilling;
+            bool has_blocked = this->blocked_producers > 0;
             this->lock.unlock();
 
+            if (has_blocked) {
+                this->space.notify_all();
+            }
+
+            if (!events_to_test.empty() && this->trace) {
+                this->record(&events_to_test);
+            }
+
+            uint64_t depth = events_to_test.size();
             if (events_to_test.empty()) {
-                std::this_thread::sleep_for(std::chrono::microseconds(DEQUE_SLEEP_DELAY));
-            } else {
-                this->event_count += events_to_test.size();
-                this->valid &= test_events(this->data_structure, &events_to_test, false);
-
-                if (!this->valid) {
-                    if (this->concurrent_data_structure) {
-                        std::cout << "  - Concurrent State: ";
-                        this->concurrent_data_structure->print_state();
-                        std::cout << std::endl;
-                    }
-                    this->event_count -= events_to_test.size();
-                    break;
+                if (running) {
+                    this->wait_for_batch();
+                }
+            } else if (spilling) {
+                // The checker threads may already have found a violation,
+                // so `valid` is only ever reset
+                if (!this->spill_events(&events_to_test)) {
+                    this->valid = false;
                 }
+            } else if (this->checkers.size() > 1) {
+                this->dispatch(&events_to_test);
+            } else if (!this->check(this->checkers[0], &events_to_test)) {
+                this->valid = false;
+            }
+
+            if (depth > 0) {
+                this->stats.add_batch(depth, history_clock() - oldest_time);
             }
+
+            if (!this->valid) {
+                break;
+            }
+        }
+
+        // Producers can't wait for space anymore, once the monitor stopped
+        this->lock.lock();
+        this->closed = true;
+        this->lock.unlock();
+        this->space.notify_all();
+
+        if (this->checkers.size() > 1) {
+            this->checkers_done = true;
+            for (EventChecker<DS, Op>* checker : this->checkers) {
+                checker->signal.notify();
+                checker->thread.join();
+            }
+        }
+
+        if (this->valid && this->spill && !this->replay_spill()) {
+            this->valid = false;
+        }
+
+        uint64_t event_count = 0;
+        for (EventChecker<DS, Op>* checker : this->checkers) {
+            event_count += checker->event_count;
+        }
+
+        if (this->quiet) {
+            return this->valid;
+        }
+
+        if (!this->valid && this->concurrent_data_structure) {
+            std::cout << "  - Concurrent State: ";
+            this->concurrent_data_structure->print_state();
+            std::cout << std::endl;
         }
 
         if (this->valid) {
-            std::cout << "Successfully validated " << this->event_count << " events" << std::endl;
+            std::cout << "Successfully validated " << event_count << " events";
+            if (this->sample_rate > 1) {
+                std::cout << " (sampling 1/" << this->sample_rate << " of the keys)";
+            }
+            std::cout << std::endl;
         } else {
-            std::cout << "Validation failed after " << this->event_count << " events" << std::endl;
+            std::cout << "Validation failed after " << event_count << " events" << std::endl;
         }
+        this->stats.print(this->ring.capacity());
 
         return this->valid;
     }
@@ -346,16 +1147,313 @@ public:
         this->concurrent_data_structure = cas;
     }
 
+    /// Skips the report printed by `monitor`, for callers which print their
+    /// own output and check `is_valid` instead.
+    void set_quiet(bool quiet) {
+        this->quiet = quiet;
+    }
+
+    /// Streams all events into the given trace, in the order of the linearized
+    /// sequence. This has to be set before any events are added.
+    void set_trace_writer(TraceWriter* trace) {
+        this->trace = trace;
+    }
+
+    /// Only validates the operations on every `rate`-th key, selected by
+    /// [`key_hash`]. Operations on other keys skip the monitor entirely and
+    /// are neither validated nor traced. Sampling requires independent keys,
+    /// the rate is ignored if the operators aren't partitioned. This has to
+    /// be set before any events are added.
+    void set_sample_rate(int rate) {
+        if (IsPartitioned<Op>::value && rate > 1) {
+            this->sample_rate = rate;
+        }
+    }
+
+    /// Limits the number of queued events to `capacity`. The policy decides
+    /// what happens, once the queue is full. This has to be set before any
+    /// events are added.
+    void set_overflow_policy(OverflowPolicy policy, size_t capacity = MONITOR_RING_CAPACITY) {
+        this->overflow_policy = policy;
+        this->ring.resize(capacity);
+    }
+
+    /// Sets the file for events spilled by the `OverflowSpill` policy.
+    void set_spill_file(const char* path) {
+        this->spill_path = path;
+    }
+
+    MonitorStats& get_stats() {
+        return this->stats;
+    }
+
+    bool is_sampled(Operation<Op>& op) {
+        return this->sample_rate == 1 || key_hash(partition_key(op)) % this->sample_rate == 0;
+    }
+
 private:
-    std::queue<Event<Op>*> events_to_test;
+    /// Applies the overflow policy, while the ring is full. This is called by
+    /// a producer with `lock` held. Returns `false`, if the event should be
+    /// dropped instead of queued.
+    bool make_room(Event<Op>* event) {
+        this->stats.overflows += 1;
+        if (this->overflow_policy == OverflowSpill) {
+            this->spilling = true;
+        } else if (this->overflow_policy == OverflowSample && IsPartitioned<Op>::value) {
+            if (this->sample_rate < MONITOR_OVERFLOW_SAMPLE_RATE) {
+                this->sample_rate = MONITOR_OVERFLOW_SAMPLE_RATE;
+            }
+            if (!this->is_sampled(event->op)) {
+                return false;
+            }
+        }
+
+        // The monitor might be waiting for a full batch, which is larger than the ring
+        this->signal.notify();
+        this->blocked_producers += 1;
+        while (this->ring.is_full() && !this->closed) {
+            this->space.wait(this->lock);
+        }
+        this->blocked_producers -= 1;
+        return !this->closed;
+    }
+
+    /// Writes the given events into the spill file instead of validating them.
+    bool spill_events(std::queue<Event<Op>*>* events) {
+        if (!this->spill) {
+            this->spill = new TraceWriter(this->spill_path, trace_operator_type(Op()));
+            if (!this->spill->is_open()) {
+                return false;
+            }
+        }
+
+        while (!events->empty()) {
+            Event<Op>* event = events->front();
+            if (!event->wait_complete()) {
+                std::cout << "Validation failed current event `";
+                event->print();
+                std::cout << "` was never marked as completed" << std::endl;
+                return false;
+            }
+            this->spill->append(make_trace_record(event));
+            release_event(event);
+            events->pop();
+        }
+        return true;
+    }
+
+    /// Validates the spilled events. The spill file only contains events,
+    /// which were queued after all events given to the checkers.
+    bool replay_spill() {
+        this->spill->close();
+        TraceReader reader(this->spill_path);
+        if (!reader.is_valid()) {
+            return false;
+        }
+
+        bool valid = true;
+        const TraceRecord* records = reader.records();
+        for (uint64_t i = 0; i < reader.size() && valid; i++) {
+            Event<Op> event((Op)records[i].op, records[i].argument, records[i].output);
+            unsigned int key = partition_key(event.op);
+            EventChecker<DS, Op>* checker = this->checkers[key % this->checkers.size()];
+            valid = test_event(checker->data_structure, &event);
+            checker->event_count += valid;
+        }
+
+        remove(this->spill_path);
+        return valid;
+    }
+
+    /// Appends the given events to the trace. The events are written by the
+    /// monitor thread, to keep the producers fast.
+    void record(std::queue<Event<Op>*>* events) {
+        int size = events->size();
+        for (int i = 0; i < size; i++) {
+            Event<Op>* event = events->front();
+            events->pop();
+            // Events which are never completed are reported during validation
+            if (event->wait_complete()) {
+                this->trace->append(make_trace_record(event));
+            }
+            events->push(event);
+        }
+    }
+
+    /// Distributes the given events to the checkers. Events with the same
+    /// key are always assigned to the same checker, in sequence order.
+    void dispatch(std::queue<Event<Op>*>* events) {
+        int checker_count = this->checkers.size();
+        std::vector<std::queue<Event<Op>*>> shards(checker_count);
+        while (!events->empty()) {
+            Event<Op>* event = events->front();
+            unsigned int key = partition_key(event->op);
+            shards[key % checker_count].push(event);
+            events->pop();
+        }
+
+        for (int i = 0; i < checker_count; i++) {
+            if (shards[i].empty()) {
+                continue;
+            }
+            EventChecker<DS, Op>* checker = this->checkers[i];
+            checker->lock.lock();
+            while (!shards[i].empty()) {
+                checker->events_to_test.push(shards[i].front());
+                shards[i].pop();
+            }
+            size_t pending = checker->events_to_test.size();
+            checker->lock.unlock();
+            checker->signal.notify();
+
+            // Stop taking events from the ring, if a checker falls behind.
+            // The producers will then run into the overflow policy.
+            while (pending > this->ring.capacity() && this->valid) {
+                std::this_thread::yield();
+                checker->lock.lock();
+                pending = checker->events_to_test.size();
+                checker->lock.unlock();
+            }
+        }
+    }
+
+    /// Returns the slab of the calling thread. The slab is cached in a thread
+    /// local variable. The `id` of the monitor is used to detect, if the cached
+    /// slab belongs to another monitor.
+    EventSlab<Op>* local_slab() {
+        thread_local uint64_t cached_id = 0;
+        thread_local EventSlab<Op>* cached_slab = nullptr;
+
+        if (cached_id != this->id) {
+            cached_slab = new EventSlab<Op>();
+            cached_id = this->id;
+
+            this->slabs_lock.lock();
+            this->slabs.push_back(cached_slab);
+            this->slabs_lock.unlock();
+        }
+
+        return cached_slab;
+    }
+
+    /// Sleeps until `MONITOR_BATCH_SIZE` events are queued or the monitor
+    /// is finished.
+    void wait_for_batch() {
+        uint32_t sequence = this->signal.prepare();
+        this->lock.lock();
+        bool ready = this->ring.size() >= MONITOR_BATCH_SIZE || this->ring.is_full();
+        this->lock.unlock();
+
+        if (ready || this->stop) {
+            this->signal.cancel();
+        } else {
+            this->signal.wait(sequence);
+        }
+    }
+
+    /// Validates the given events with the data structure of the checker
+    bool check(EventChecker<DS, Op>* checker, std::queue<Event<Op>*>* events) {
+        int size = events->size();
+        bool valid = test_events(checker->data_structure, events, false);
+        checker->event_count += size - events->size();
+        return valid;
+    }
+
+    void checker_thread_func(EventChecker<DS, Op>* checker) {
+        bool running = true;
+        while (running && this->valid) {
+            if (this->checkers_done) {
+                running = false;
+            }
+
+            uint32_t sequence = checker->signal.prepare();
+            std::queue<Event<Op>*> events_to_test;
+            checker->lock.lock();
+            checker->events_to_test.swap(events_to_test);
+            checker->lock.unlock();
+
+            if (!events_to_test.empty() || this->checkers_done) {
+                checker->signal.cancel();
+            } else {
+                checker->signal.wait(sequence);
+            }
+
+            if (events_to_test.empty()) {
+                continue;
+            } else if (!this->check(checker, &events_to_test)) {
+                this->valid = false;
+            }
+        }
+    }
+
+    /// Used to identify the monitor in [`EventMonitor::local_slab`]
+    static inline std::atomic<uint64_t> next_monitor_id = 1;
+    uint64_t id;
+
+    /// The queued events, protected by `lock`.
+    EventRing<Op> ring;
     std::mutex lock;
+    /// Wakes the monitor thread, once a batch of events is ready.
+    WakeSignal signal;
+    /// Wakes producers waiting for space in the ring.
+    std::condition_variable_any space;
+    int blocked_producers = 0;
+    /// Set once the monitor doesn't take any more events.
+    bool closed = false;
+
+    OverflowPolicy overflow_policy = OverflowBlock;
+    /// Set by the `OverflowSpill` policy, once the ring was full.
+    bool spilling = false;
+    const char* spill_path = MONITOR_SPILL_FILE;
+    TraceWriter* spill = nullptr;
+    MonitorStats stats;
+
+    /// The slabs of all threads, which reserved events.
+    std::vector<EventSlab<Op>*> slabs;
+    std::mutex slabs_lock;
 
     // For monitoring and validation
-    DS* data_structure;
-    int event_count = 0;
-    bool stop = false;
-    bool valid = true;
+    std::vector<EventChecker<DS, Op>*> checkers;
+    std::atomic<bool> stop = false;
+    std::atomic<bool> checkers_done = false;
+    std::atomic<bool> valid = true;
+    bool quiet = false;
 
     /// The concurrent data structure, to print the internal state:
     CAS* concurrent_data_structure;
+    /// The trace, which receives all events, if set.
+    TraceWriter* trace = nullptr;
+    /// Only every `sample_rate`-th key is validated, see `set_sample_rate`.
+    /// The `OverflowSample` policy raises the rate while producers are running.
+    std::atomic<int> sample_rate = 1;
 };
+
+/// A monitor policy, which discards all events. The data structures take their
+/// monitor as a template parameter, [`EventMonitor`] validates the events for
+/// tests, while this policy is used for benchmarks and production builds.
+/// All functions are empty and get inlined, no event is ever stored.
+template<typename Op>
+class NullMonitor {
+public:
+    static constexpr bool enabled = false;
+
+    void add(Event<Op> event) {}
+
+    Event<Op>* reserve(Event<Op> event) {
+        return scratch_event<Op>();
+    }
+
+    /// A shared instance for data structures, which are created without a monitor.
+    static NullMonitor* instance() {
+        static NullMonitor monitor;
+        return &monitor;
+    }
+};
+
+class StdSet;
+class StdMultiset;
+
+/// The validating monitor policy for sets.
+typedef EventMonitor<Set, StdSet, SetOperator> SetMonitor;
+/// The validating monitor policy for multisets.
+typedef EventMonitor<Multiset, StdMultiset, MultisetOperator> MultisetMonitor;
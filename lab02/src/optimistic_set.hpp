@@ -2,6 +2,7 @@
 
 #include "set.hpp"
 #include "std_set.hpp"
+#include "instrument.hpp"
 
 #include <atomic>
 #include <mutex>
@@ -26,7 +27,7 @@ struct OptimisticSetNode {
   /// <https://en.cppreference.com/w/cpp/atomic/atomic>
   std::atomic<OptimisticSetNode *> next;
 
-  std::mutex lock;
+  InstrumentedMutex lock;
 
   OptimisticSetNode(int elem = 0, OptimisticSetNode *nextN = nullptr)
       : value(elem), next(nextN) {}
@@ -68,12 +69,17 @@ private:
       next = next->next;
     }
 
-    return current == p && next == c;
+    bool valid = current == p && next == c;
+    if (!valid) {
+      INSTRUMENT_COUNT(ContentionValidateFailures);
+    }
+    return valid;
   }
 
 public:
   bool add(int elem) override {
     bool result = false;
+    PHASE_BEGIN();
     // A01: Add code to insert the element into the set and update result.
 
     OptimisticSetNode *current = head;
@@ -85,26 +91,36 @@ public:
       next = next->next.load();
     }
 
+    PHASE_MARK(PhaseTraversal);
+
     // Lock
     current->lock.lock();
     next->lock.lock();
+    PHASE_MARK(PhaseLock);
 
     // If postion exists
-    if (validate(current, next)) {
+    bool valid = validate(current, next);
+    PHASE_MARK(PhaseValidation);
+    if (valid) {
       if (next->value > elem) { // Add element if element exist
-        current->next.store(new OptimisticSetNode(elem, next));
+        OptimisticSetNode *node = new OptimisticSetNode(elem, next);
+        PHASE_MARK(PhaseAllocation);
+        current->next.store(node);
         result = true;
       }
     }
 
+    PHASE_MARK(PhaseLinearization);
     current->lock.unlock();
     next->lock.unlock();
+    PHASE_MARK(PhaseLock);
 
     return result;
   }
 
   bool rmv(int elem) override {
     bool result = false;
+    PHASE_BEGIN();
     // A01: Add code to remove the element from the set and update `result`.
     OptimisticSetNode *current = head;
     OptimisticSetNode *next = current->next.load();
@@ -115,27 +131,36 @@ public:
       next = next->next.load();
     }
 
+    PHASE_MARK(PhaseTraversal);
+
     // Lock
     current->lock.lock();
     next->lock.lock();
+    PHASE_MARK(PhaseLock);
 
     // Validate and remove the element
-    if (validate(current, next)) {
+    bool valid = validate(current, next);
+    PHASE_MARK(PhaseValidation);
+    if (valid) {
       if (next->value == elem) {
         current->next.store(next->next.load());
         result = true;
       }
     }
 
+    PHASE_MARK(PhaseLinearization);
+
     // Unlock nodes
     next->lock.unlock();
     current->lock.unlock();
+    PHASE_MARK(PhaseLock);
 
     return result;
   }
 
   bool ctn(int elem) override {
     bool result = false;
+    PHASE_BEGIN();
     // A01: Add code to check if the element is inside the set and update
     // `result`.
     OptimisticSetNode *current = head;
@@ -147,20 +172,27 @@ public:
       next = next->next.load();
     }
 
+    PHASE_MARK(PhaseTraversal);
+
     // Lock
     current->lock.lock();
     next->lock.lock();
+    PHASE_MARK(PhaseLock);
 
     // If postion exists
-    if (validate(current, next)) {
+    bool valid = validate(current, next);
+    PHASE_MARK(PhaseValidation);
+    if (valid) {
       if (current->value == elem) {
         // Element exists
         result = true;
       }
     }
 
+    PHASE_MARK(PhaseLinearization);
     current->lock.unlock();
     next->lock.unlock();
+    PHASE_MARK(PhaseLock);
 
     return result;
   }
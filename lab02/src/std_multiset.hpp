@@ -2,39 +2,109 @@
 
 #include "set.hpp"
 
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#ifndef DENSE_KEY_LIMIT
+/// Keys in `[0, DENSE_KEY_LIMIT)` are stored in dense arrays by the reference
+/// data structures. Other keys fall back to a tree.
+#define DENSE_KEY_LIMIT 65536
+#endif
+
+/// The sequential reference multiset. Small non-negative keys are counted
+/// in an array, which grows with the largest key. All other keys are
+/// counted in a `std::map`.
 class StdMultiset: public Multiset {
    public:
     int add(int value) override {
-        this->state.insert(value);
+        if (!is_dense(value)) {
+            this->sparse[value] += 1;
+            return true;
+        }
+        if (value >= (int)this->counts.size()) {
+            this->counts.resize(value + 1, 0);
+        }
+        this->counts[value] += 1;
         return true;
     }
 
     int rmv(int value) override {
-        if (this->state.count(value) > 0) {
-            this->state.erase(this->state.find(value));
-            return true;
+        if (this->ctn(value) == 0) {
+            return false;
         }
-        return false;
+        if (!is_dense(value)) {
+            auto it = this->sparse.find(value);
+            it->second -= 1;
+            if (it->second == 0) {
+                this->sparse.erase(it);
+            }
+        } else {
+            this->counts[value] -= 1;
+        }
+        return true;
     }
 
     int ctn(int value) override {
-        return this->state.count(value);
+        if (!is_dense(value)) {
+            auto it = this->sparse.find(value);
+            return it == this->sparse.end() ? 0 : it->second;
+        }
+        if (value >= (int)this->counts.size()) {
+            return 0;
+        }
+        return this->counts[value];
+    }
+
+    bool operator==(const StdMultiset& other) const {
+        if (this->sparse != other.sparse) {
+            return false;
+        }
+        // The arrays only differ in size, if the missing counts are zero
+        size_t size = std::max(this->counts.size(), other.counts.size());
+        for (size_t i = 0; i < size; i++) {
+            int count = i < this->counts.size() ? this->counts[i] : 0;
+            int other_count = i < other.counts.size() ? other.counts[i] : 0;
+            if (count != other_count) {
+                return false;
+            }
+        }
+        return true;
     }
 
     void print_state() override {
         std::cout << "{";
         bool first = true;
-        for (auto it = this->state.begin(); it != this->state.end(); it++) {
-            if (first) {
-                first = false;
-            } else {
-                std::cout << ", ";
+        auto print_elem = [&](int value, int count) {
+            for (int i = 0; i < count; i++) {
+                if (first) {
+                    first = false;
+                } else {
+                    std::cout << ", ";
+                }
+                std::cout << value;
             }
-            std::cout << *it;
+        };
+
+        // Negative keys are stored in the map, but come before the array
+        auto it = this->sparse.begin();
+        for (; it != this->sparse.end() && it->first < 0; it++) {
+            print_elem(it->first, it->second);
+        }
+        for (int value = 0; value < (int)this->counts.size(); value++) {
+            print_elem(value, this->counts[value]);
+        }
+        for (; it != this->sparse.end(); it++) {
+            print_elem(it->first, it->second);
         }
         std::cout << "}";
     }
 
    private:
-    std::multiset<int> state;
+    static bool is_dense(int value) {
+        return value >= 0 && value < DENSE_KEY_LIMIT;
+    }
+
+    std::vector<int> counts;
+    std::map<int, int> sparse;
 };
@@ -1,76 +1,502 @@
 #pragma once
 
 #include "monitoring.hpp"
+#include "linearizability.hpp"
+#include "histogram.hpp"
+#include "affinity.hpp"
+#include "counters.hpp"
+#include "worker_pool.hpp"
+#include "memory.hpp"
 
-#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/// Open-loop workers sleep until shortly before the intended start of the
+/// next operation and spin for the remaining nanoseconds.
+#define OPEN_LOOP_SPIN_NS 50000
+/// The first operation of an open-loop run is scheduled this many
+/// nanoseconds after the threads are started, so that thread creation
+/// isn't counted as latency.
+#define OPEN_LOOP_START_DELAY_NS 1000000
+/// Duration workers read the clock once every this many operations.
+#define DURATION_CHECK_OPS 64
 
 template <class CDS, typename Op>
-void worker_thread_func(CDS* data_structure, OpGenerator<Op>* generator, int thread_id) {
-    while (auto maybe_operation = generator->next()) {
+void worker_thread_func(CDS* data_structure, OpGenerator<Op>* generator, int thread_id, int thread_count = 1) {
+    OpStream<Op> stream = generator->stream(thread_id, thread_count);
+    while (auto maybe_operation = stream.next()) {
         Operation<Op> operation = maybe_operation.value();
         apply_op(data_structure, operation);
     }
 }
 
-template <class CDS, class DS, typename Op>
-void monitor_thread_func(EventMonitor<CDS, DS, Op>* monitor) {
+/// A worker which performs the operations of a pre-generated tape. If
+/// `latencies` is given, the latency of every operation is recorded in ns.
+template <class CDS, typename Op>
+void tape_worker_thread_func(CDS* data_structure, OpTape<Op>* tape, OpHistograms<Op>* latencies) {
+    if (latencies == nullptr) {
+        for (size_t i = 0; i < tape->size(); i++) {
+            Operation<Op> operation(tape->ops[i], tape->arguments[i]);
+            apply_op(data_structure, operation);
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < tape->size(); i++) {
+        Operation<Op> operation(tape->ops[i], tape->arguments[i]);
+        uint64_t invoke = history_clock();
+        apply_op(data_structure, operation);
+        latencies->record(operation.op, history_clock() - invoke);
+    }
+}
+
+/// A worker which repeats the operations of the tape until `duration` ns
+/// passed, and stores the number of completed operations in `completed`.
+/// If `latencies` is given, the latency of every operation is recorded.
+template <class CDS, typename Op>
+void duration_worker_thread_func(
+    CDS* data_structure,
+    OpTape<Op>* tape,
+    uint64_t duration,
+    uint64_t* completed,
+    OpHistograms<Op>* latencies
+) {
+    uint64_t deadline = history_clock() + duration;
+    uint64_t count = 0;
+    size_t i = 0;
+    while (tape->size() > 0) {
+        if (count % DURATION_CHECK_OPS == 0 && history_clock() >= deadline) {
+            break;
+        }
+        Operation<Op> operation(tape->ops[i], tape->arguments[i]);
+        if (latencies == nullptr) {
+            apply_op(data_structure, operation);
+        } else {
+            uint64_t invoke = history_clock();
+            apply_op(data_structure, operation);
+            latencies->record(operation.op, history_clock() - invoke);
+        }
+        count += 1;
+        i = i + 1 == tape->size() ? 0 : i + 1;
+    }
+    *completed = count;
+}
+
+/// How an open-loop worker spaces its operations.
+enum ArrivalProcess {
+    /// The operations start at a fixed interval.
+    ArrivalFixed = 1,
+    /// The gaps between operations are exponentially distributed, like the
+    /// requests of many independent clients.
+    ArrivalPoisson = 2,
+};
+
+/// The intended start times of the operations of an open-loop worker.
+struct ArrivalSchedule {
+    ArrivalProcess process;
+    /// The mean gap between two operations in nanoseconds.
+    double interval;
+    uint64_t seed;
+    uint64_t counter = 0;
+
+    ArrivalSchedule(ArrivalProcess process, double interval, uint64_t seed) :
+        process(process),
+        interval(interval),
+        seed(seed)
+    {}
+
+    /// Returns the gap to the next operation in nanoseconds.
+    double next_gap() {
+        if (this->process != ArrivalPoisson) {
+            return this->interval;
+        }
+        this->counter += 1;
+        uint64_t random = splitmix64(this->seed + this->counter * SPLITMIX_GAMMA);
+        // A uniform value in (0, 1], the logarithm is therefore finite
+        double u = ((random >> 11) + 1) / 9007199254740992.0;
+        return -std::log(u) * this->interval;
+    }
+};
+
+/// Waits until `history_clock` reaches the given time. This sleeps until
+/// shortly before and spins for the rest, since sleeps are imprecise.
+void wait_until(double time) {
+    uint64_t now = history_clock();
+    if (time > now + OPEN_LOOP_SPIN_NS) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds((uint64_t)time - now - OPEN_LOOP_SPIN_NS));
+    }
+    while (history_clock() < time) {
+        std::this_thread::yield();
+    }
+}
+
+/// The timing of the operations of an open-loop worker.
+struct OpenLoopTimes {
+    /// The latency of every operation in ns.
+    std::vector<uint64_t> latencies;
+    /// The intended start of the first operation.
+    uint64_t first_arrival = UINT64_MAX;
+    /// The time the last operation returned.
+    uint64_t last_completion = 0;
+};
+
+/// A worker which issues the operations of the tape at the intended start
+/// times of the schedule, instead of right after the previous operation
+/// returned. The latency is measured from the intended start and therefore
+/// includes the time an operation was delayed by its predecessors, which
+/// closed-loop workers omit.
+template <class CDS, typename Op>
+void open_loop_worker_thread_func(
+    CDS* data_structure,
+    OpTape<Op>* tape,
+    ArrivalSchedule schedule,
+    uint64_t start,
+    OpenLoopTimes* times
+) {
+    times->latencies.reserve(tape->size());
+    double intended = start;
+    for (size_t i = 0; i < tape->size(); i++) {
+        intended += schedule.next_gap();
+        if (i == 0) {
+            times->first_arrival = intended;
+        }
+        wait_until(intended);
+
+        Operation<Op> operation(tape->ops[i], tape->arguments[i]);
+        apply_op(data_structure, operation);
+        times->last_completion = history_clock();
+        times->latencies.push_back(times->last_completion - (uint64_t)intended);
+    }
+}
+
+/// How the operations of a trace are replayed.
+enum ReplayMode {
+    /// Every thread of the trace performs its operations in the original
+    /// order, as fast as possible.
+    ReplayOrdered = 1,
+    /// Additionally, every operation is started at its original offset from
+    /// the start of the trace.
+    ReplayTimed = 2,
+};
+
+/// Returns the indices of the trace records, grouped by the thread which
+/// performed them. The records of every thread keep their original order.
+std::vector<std::vector<uint64_t>> split_trace(TraceReader* trace) {
+    std::map<uint16_t, std::vector<uint64_t>> threads;
+    const TraceRecord* records = trace->records();
+    for (uint64_t i = 0; i < trace->size(); i++) {
+        threads[records[i].thread_id].push_back(i);
+    }
+
+    std::vector<std::vector<uint64_t>> split;
+    for (auto& [thread_id, indices] : threads) {
+        split.push_back(std::move(indices));
+    }
+    return split;
+}
+
+/// A worker which replays the given records of a memory mapped trace. The
+/// latency of an operation is measured from its invocation, or from its
+/// intended start for `ReplayTimed`.
+template <class CDS, typename Op>
+void replay_worker_thread_func(
+    CDS* data_structure,
+    const TraceRecord* records,
+    std::vector<uint64_t>* indices,
+    ReplayMode mode,
+    uint64_t start,
+    uint64_t trace_start,
+    std::vector<uint64_t>* latencies
+) {
+    latencies->reserve(indices->size());
+    for (uint64_t index : *indices) {
+        const TraceRecord& record = records[index];
+        uint64_t invoke;
+        if (mode == ReplayTimed) {
+            invoke = start + (record.invoke - trace_start);
+            wait_until(invoke);
+        } else {
+            invoke = history_clock();
+        }
+
+        Operation<Op> operation((Op)record.op, record.argument);
+        apply_op(data_structure, operation);
+        latencies->push_back(history_clock() - invoke);
+    }
+}
+
+/// A worker which records the invocation and response time of every
+/// operation into its own history. The history is only validated after
+/// all threads have finished, see [`check_histories`].
+template <class CDS, typename Op>
+void history_worker_thread_func(
+    CDS* data_structure,
+    OpGenerator<Op>* generator,
+    ThreadHistory<Op>* history,
+    int thread_id,
+    int thread_count
+) {
+    OpStream<Op> stream = generator->stream(thread_id, thread_count);
+    // Growing the history would allocate within the recorded intervals
+    history->reserve(stream.size());
+    while (auto maybe_operation = stream.next()) {
+        Operation<Op> operation = maybe_operation.value();
+        uint64_t invoke = history_clock();
+        int output = apply_op(data_structure, operation);
+        uint64_t response = history_clock();
+        history->push_back(HistoryEntry<Op> {operation, output, invoke, response, thread_id});
+    }
+}
+
+template <class Monitor>
+void monitor_thread_func(Monitor* monitor) {
     monitor->monitor();
 }
 
+/// Runs the operations of the generator, split over `thread_count` workers
+/// of the pool.
 template <typename CDS, typename Op>
 void run_data_structure_n_threads(
     CDS* concurrent_data_structure,
-    OpGenerator<Op>** generator,
+    OpGenerator<Op>* generator,
     int thread_count
 ) {
-    // Setup threads
-    void *ptr = malloc(sizeof(std::thread) * thread_count);
-    memset(ptr, 0, sizeof(std::thread) * thread_count);
-    std::thread *workers = (std::thread *)ptr;
-    for (int thread_id = 0; thread_id < thread_count; thread_id++) {
-        workers[thread_id] = std::thread(
-            worker_thread_func<CDS, Op>,
-            std::ref(concurrent_data_structure),
-            std::ref(generator[thread_id]),
-            std::ref(thread_id)
+    worker_pool().run(thread_count, [&](int thread_id) {
+        worker_thread_func<CDS, Op>(concurrent_data_structure, generator, thread_id, thread_count);
+    });
+}
+
+/// Runs every tape on its own worker of the pool. Returns the time in ms
+/// from the release of the workers, until the last one finished. If
+/// `latencies` is given, every thread records the latencies of its
+/// operations, which are merged into `latencies` at the end. The workers
+/// are pinned to CPUs according to `placement`. If `counters` is given,
+/// every worker counts the events of `COUNTER_EVENTS` while performing its
+/// operations, which are added to `counters`. If `allocations` is given,
+/// it receives the heap allocations of the operations of every worker,
+/// which are only counted while memory tracking is enabled.
+template <typename CDS, typename Op>
+double run_data_structure_n_threads(
+    CDS* concurrent_data_structure,
+    std::vector<OpTape<Op>>* tapes,
+    OpHistograms<Op>* latencies = nullptr,
+    PlacementPolicy placement = PlacementNone,
+    CounterTotals* counters = nullptr,
+    std::vector<uint64_t>* allocations = nullptr
+) {
+    std::vector<int> cpus = placement_cpus(placement, tapes->size());
+    std::vector<OpHistograms<Op>> thread_latencies(tapes->size());
+    std::vector<CounterTotals> thread_counters(tapes->size());
+    if (allocations) {
+        allocations->assign(tapes->size(), 0);
+    }
+    // Opening and closing the counters are syscalls, which aren't timed
+    std::vector<std::unique_ptr<PerfCounterGroup>> groups(tapes->size());
+    WorkerTask task;
+    if (counters) {
+        task.setup = [&](int thread_id) {
+            groups[thread_id] = std::make_unique<PerfCounterGroup>();
+        };
+        task.teardown = [&](int thread_id) {
+            groups[thread_id].reset();
+        };
+    }
+    task.task = [&](int thread_id) {
+        if (counters) {
+            groups[thread_id]->start();
+        }
+        uint64_t allocated = thread_allocations();
+        tape_worker_thread_func<CDS, Op>(
+            concurrent_data_structure,
+            &(*tapes)[thread_id],
+            latencies ? &thread_latencies[thread_id] : nullptr
         );
+        if (allocations) {
+            (*allocations)[thread_id] = thread_allocations() - allocated;
+        }
+        if (counters) {
+            groups[thread_id]->stop(&thread_counters[thread_id]);
+        }
+    };
+    double time = worker_pool().run(tapes->size(), task, cpus);
+
+    if (latencies) {
+        for (OpHistograms<Op>& histograms : thread_latencies) {
+            latencies->merge(histograms);
+        }
     }
+    if (counters) {
+        for (CounterTotals& totals : thread_counters) {
+            counters->merge(totals);
+        }
+    }
+
+    return time;
+}
 
-    // Join threads
-    for (int i = 0; i < thread_count; i++) {
-        workers[i].join();
+/// Runs every tape on its own worker of the pool for `duration` ms, where
+/// the workers start over at the beginning of their tape when they reach
+/// its end. The number of operations completed by every worker is stored
+/// in `completed`. Returns the time in ms until the last worker stopped,
+/// which is slightly longer than `duration`. The other arguments are like
+/// for `run_data_structure_n_threads`.
+template <typename CDS, typename Op>
+double run_data_structure_for_duration(
+    CDS* concurrent_data_structure,
+    std::vector<OpTape<Op>>* tapes,
+    double duration,
+    std::vector<uint64_t>* completed,
+    OpHistograms<Op>* latencies = nullptr,
+    PlacementPolicy placement = PlacementNone,
+    CounterTotals* counters = nullptr,
+    std::vector<uint64_t>* allocations = nullptr
+) {
+    std::vector<int> cpus = placement_cpus(placement, tapes->size());
+    std::vector<OpHistograms<Op>> thread_latencies(tapes->size());
+    std::vector<CounterTotals> thread_counters(tapes->size());
+    completed->assign(tapes->size(), 0);
+    if (allocations) {
+        allocations->assign(tapes->size(), 0);
+    }
+    // Opening and closing the counters are syscalls, which aren't timed
+    std::vector<std::unique_ptr<PerfCounterGroup>> groups(tapes->size());
+    WorkerTask task;
+    if (counters) {
+        task.setup = [&](int thread_id) {
+            groups[thread_id] = std::make_unique<PerfCounterGroup>();
+        };
+        task.teardown = [&](int thread_id) {
+            groups[thread_id].reset();
+        };
+    }
+    task.task = [&](int thread_id) {
+        if (counters) {
+            groups[thread_id]->start();
+        }
+        uint64_t allocated = thread_allocations();
+        duration_worker_thread_func<CDS, Op>(
+            concurrent_data_structure,
+            &(*tapes)[thread_id],
+            duration * 1000000.0,
+            &(*completed)[thread_id],
+            latencies ? &thread_latencies[thread_id] : nullptr
+        );
+        if (allocations) {
+            (*allocations)[thread_id] = thread_allocations() - allocated;
+        }
+        if (counters) {
+            groups[thread_id]->stop(&thread_counters[thread_id]);
+        }
+    };
+    double time = worker_pool().run(tapes->size(), task, cpus);
+
+    if (latencies) {
+        for (OpHistograms<Op>& histograms : thread_latencies) {
+            latencies->merge(histograms);
+        }
+    }
+    if (counters) {
+        for (CounterTotals& totals : thread_counters) {
+            counters->merge(totals);
+        }
     }
 
-    // Cleanup
-    free(workers);
+    return time;
 }
 
+/// Runs every tape on its own open-loop worker, which starts an operation
+/// every `interval` nanoseconds on average. Returns the latencies of all
+/// operations in nanoseconds, and the span from the first intended start
+/// to the last completion.
 template <typename CDS, typename Op>
-void run_data_structure_n_threads(
+OpenLoopTimes run_data_structure_n_threads_open_loop(
     CDS* concurrent_data_structure,
-    OpGenerator<Op>* generator,
-    int thread_count
+    std::vector<OpTape<Op>>* tapes,
+    ArrivalProcess process,
+    double interval,
+    uint64_t seed
 ) {
-    // Use the same generator for every thread
-    OpGenerator<Op>** generators = new OpGenerator<Op>*[thread_count];
-    for (int i = 0; i < thread_count; i++) {
-        generators[i] = generator;
+    std::vector<OpenLoopTimes> times(tapes->size());
+    uint64_t start = history_clock() + OPEN_LOOP_START_DELAY_NS;
+
+    std::vector<std::thread> workers;
+    for (size_t thread_id = 0; thread_id < tapes->size(); thread_id++) {
+        ArrivalSchedule schedule(process, interval, splitmix64(seed + (thread_id + 1) * SPLITMIX_GAMMA));
+        workers.push_back(std::thread(
+            open_loop_worker_thread_func<CDS, Op>,
+            concurrent_data_structure,
+            &(*tapes)[thread_id],
+            schedule,
+            start,
+            &times[thread_id]
+        ));
     }
 
-    run_data_structure_n_threads(concurrent_data_structure, generators, thread_count);
+    OpenLoopTimes all_times;
+    for (size_t thread_id = 0; thread_id < workers.size(); thread_id++) {
+        workers[thread_id].join();
+        OpenLoopTimes& thread_times = times[thread_id];
+        all_times.latencies.insert(all_times.latencies.end(), thread_times.latencies.begin(), thread_times.latencies.end());
+        all_times.first_arrival = std::min(all_times.first_arrival, thread_times.first_arrival);
+        all_times.last_completion = std::max(all_times.last_completion, thread_times.last_completion);
+    }
+    return all_times;
+}
 
-    delete[] generators;
+/// Replays the trace with one worker per thread of the trace, see
+/// [`split_trace`]. Returns the latencies of all operations in nanoseconds.
+template <typename CDS, typename Op>
+std::vector<uint64_t> replay_trace_n_threads(
+    CDS* concurrent_data_structure,
+    TraceReader* trace,
+    std::vector<std::vector<uint64_t>>* threads,
+    ReplayMode mode
+) {
+    const TraceRecord* records = trace->records();
+    uint64_t trace_start = UINT64_MAX;
+    for (uint64_t i = 0; i < trace->size(); i++) {
+        trace_start = std::min(trace_start, records[i].invoke);
+    }
+
+    std::vector<std::vector<uint64_t>> latencies(threads->size());
+    uint64_t start = history_clock() + OPEN_LOOP_START_DELAY_NS;
+
+    std::vector<std::thread> workers;
+    for (size_t thread_id = 0; thread_id < threads->size(); thread_id++) {
+        workers.push_back(std::thread(
+            replay_worker_thread_func<CDS, Op>,
+            concurrent_data_structure,
+            records,
+            &(*threads)[thread_id],
+            mode,
+            start,
+            trace_start,
+            &latencies[thread_id]
+        ));
+    }
+
+    std::vector<uint64_t> all_latencies;
+    for (size_t thread_id = 0; thread_id < workers.size(); thread_id++) {
+        workers[thread_id].join();
+        all_latencies.insert(all_latencies.end(), latencies[thread_id].begin(), latencies[thread_id].end());
+    }
+    return all_latencies;
 }
 
-template <typename CDS, typename DS, typename Op>
+template <typename CDS, typename Monitor, typename Op>
 bool run_data_structure_n_threads_with_monitor(
     CDS* concurrent_data_structure,
     OpGenerator<Op>* generator,
-    EventMonitor<CDS, DS, Op>* monitor,
+    Monitor* monitor,
     int thread_count
 ) {
     // Start monitor thread
-    std::thread monitor_thread(monitor_thread_func<CDS, DS, Op>, std::ref(monitor));
+    std::thread monitor_thread(monitor_thread_func<Monitor>, std::ref(monitor));
 
     run_data_structure_n_threads(concurrent_data_structure, generator, thread_count);
 
@@ -80,3 +506,49 @@ bool run_data_structure_n_threads_with_monitor(
 
     return monitor->is_valid();
 }
+
+/// Runs the data structure in recording mode. The data structure doesn't
+/// need to report any events, instead, every worker records its own history
+/// without synchronization. Returns the histories of all threads.
+template <typename CDS, typename Op>
+std::vector<ThreadHistory<Op>> record_histories(
+    CDS* concurrent_data_structure,
+    OpGenerator<Op>* generator,
+    int thread_count
+) {
+    std::vector<ThreadHistory<Op>> histories(thread_count);
+    std::vector<std::thread> workers;
+    for (int thread_id = 0; thread_id < thread_count; thread_id++) {
+        workers.push_back(std::thread(
+            history_worker_thread_func<CDS, Op>,
+            concurrent_data_structure,
+            generator,
+            &histories[thread_id],
+            thread_id,
+            thread_count
+        ));
+    }
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    return histories;
+}
+
+/// Records the histories of the data structure, see [`record_histories`],
+/// and checks them for linearizability against the sequential
+/// specification `DS` once all threads have finished.
+template <typename CDS, typename DS, typename Op>
+bool run_data_structure_n_threads_with_history(
+    CDS* concurrent_data_structure,
+    OpGenerator<Op>* generator,
+    int thread_count
+) {
+    std::vector<ThreadHistory<Op>> histories = record_histories<CDS, Op>(
+        concurrent_data_structure,
+        generator,
+        thread_count
+    );
+    return check_histories<DS, Op>(histories);
+}
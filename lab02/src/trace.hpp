@@ -0,0 +1,244 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// The number of records, which are handed to the writer thread at once.
+#define TRACE_BUFFER_RECORDS 4096
+
+/// The first bytes of every trace file. The last character is the version.
+const char TRACE_MAGIC[8] = {'P', 'A', 'D', 'S', 'T', 'R', 'C', '1'};
+
+/// The header at the start of every trace file.
+struct TraceHeader {
+    char magic[8];
+    /// Identifies the operator enum of the records, see `trace_operator_type`.
+    uint32_t operator_type;
+    /// The size of a single [`TraceRecord`], to detect incompatible files.
+    uint32_t record_size;
+    /// The number of records following the header.
+    uint64_t record_count;
+};
+static_assert(sizeof(TraceHeader) == 24, "The trace header layout changed");
+
+/// A single operation in a trace file. The records are stored directly after
+/// the header without any encoding, a memory mapped trace file can therefore
+/// be used as an array of records.
+struct TraceRecord {
+    /// Timestamp in nanoseconds, taken before the operation was invoked.
+    uint64_t invoke;
+    /// Timestamp in nanoseconds, taken after the operation returned.
+    /// Events from the monitor use the time just before they were inserted
+    /// into the sequence for both timestamps, see `make_trace_record`.
+    uint64_t response;
+    int32_t argument;
+    int32_t output;
+    uint16_t thread_id;
+    /// The numeric value of the operator.
+    uint8_t op;
+    uint8_t padding[5];
+};
+static_assert(sizeof(TraceRecord) == 32, "The trace record layout changed");
+
+/// Streams trace records into a file. Records are collected in a buffer
+/// and a background thread writes full buffers to the file. Appending a
+/// record is therefore just a copy in most cases.
+///
+/// `append` is not thread safe, every writer should have a single producer.
+class TraceWriter {
+public:
+    TraceWriter(const char* path, uint32_t operator_type) :
+        operator_type(operator_type)
+    {
+        this->file = fopen(path, "wb");
+        if (this->file == nullptr) {
+            fprintf(stderr, "Failed to open the trace file `%s`\n", path);
+            return;
+        }
+
+        // The record count is only known, once the writer is closed
+        this->write_header(0);
+        this->buffer.reserve(TRACE_BUFFER_RECORDS);
+        this->pending.reserve(TRACE_BUFFER_RECORDS);
+        this->thread = std::thread(&TraceWriter::writer_thread_func, this);
+    }
+
+    ~TraceWriter() {
+        this->close();
+    }
+
+    bool is_open() {
+        return this->file != nullptr;
+    }
+
+    void append(const TraceRecord& record) {
+        if (!this->is_open()) {
+            return;
+        }
+        this->buffer.push_back(record);
+        if (this->buffer.size() == TRACE_BUFFER_RECORDS) {
+            this->flush();
+        }
+    }
+
+    /// Hands the buffered records to the writer thread. This blocks, if
+    /// the writer thread is still busy with the previous buffer.
+    void flush() {
+        if (this->buffer.empty() || !this->is_open()) {
+            return;
+        }
+
+        std::unique_lock<std::mutex> guard(this->lock);
+        this->idle.wait(guard, [this] { return this->pending.empty(); });
+        this->pending.swap(this->buffer);
+        this->record_count += this->pending.size();
+        this->work.notify_one();
+    }
+
+    /// Writes all remaining records and completes the header.
+    void close() {
+        if (!this->is_open()) {
+            return;
+        }
+
+        this->flush();
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->stop = true;
+        }
+        this->work.notify_one();
+        this->thread.join();
+
+        this->write_header(this->record_count);
+        fclose(this->file);
+        this->file = nullptr;
+    }
+
+    uint64_t size() {
+        return this->record_count + this->buffer.size();
+    }
+
+private:
+    void write_header(uint64_t record_count) {
+        TraceHeader header;
+        memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+        header.operator_type = this->operator_type;
+        header.record_size = sizeof(TraceRecord);
+        header.record_count = record_count;
+
+        fseek(this->file, 0, SEEK_SET);
+        fwrite(&header, sizeof(TraceHeader), 1, this->file);
+        fseek(this->file, 0, SEEK_END);
+    }
+
+    void writer_thread_func() {
+        std::unique_lock<std::mutex> guard(this->lock);
+        while (true) {
+            this->work.wait(guard, [this] { return this->stop || !this->pending.empty(); });
+            if (this->pending.empty()) {
+                break;
+            }
+
+            // The producer can't touch `pending` until it's empty again
+            guard.unlock();
+            fwrite(this->pending.data(), sizeof(TraceRecord), this->pending.size(), this->file);
+            guard.lock();
+
+            this->pending.clear();
+            this->idle.notify_one();
+        }
+    }
+
+    FILE* file = nullptr;
+    uint32_t operator_type;
+    /// The number of records handed to the writer thread.
+    uint64_t record_count = 0;
+
+    /// Filled by the producer.
+    std::vector<TraceRecord> buffer;
+    /// Written by the writer thread.
+    std::vector<TraceRecord> pending;
+    std::mutex lock;
+    std::condition_variable work;
+    std::condition_variable idle;
+    bool stop = false;
+    std::thread thread;
+};
+
+/// Provides access to the records of a trace file. The file is memory
+/// mapped, the records are used as they are stored on disk.
+class TraceReader {
+public:
+    TraceReader(const char* path) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            fprintf(stderr, "Failed to open the trace file `%s`\n", path);
+            return;
+        }
+
+        struct stat stats;
+        if (fstat(fd, &stats) == 0 && stats.st_size >= (off_t)sizeof(TraceHeader)) {
+            this->length = stats.st_size;
+            void* data = mmap(nullptr, this->length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                this->data = (char*)data;
+            }
+        }
+        ::close(fd);
+
+        if (this->data == nullptr) {
+            fprintf(stderr, "Failed to map the trace file `%s`\n", path);
+            return;
+        }
+
+        TraceHeader* header = this->header();
+        uint64_t available = (this->length - sizeof(TraceHeader)) / sizeof(TraceRecord);
+        if (memcmp(header->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0
+            || header->record_size != sizeof(TraceRecord)
+            || header->record_count > available) {
+            fprintf(stderr, "The file `%s` is not a valid trace\n", path);
+            munmap(this->data, this->length);
+            this->data = nullptr;
+        }
+    }
+
+    ~TraceReader() {
+        if (this->data) {
+            munmap(this->data, this->length);
+        }
+    }
+
+    bool is_valid() {
+        return this->data != nullptr;
+    }
+
+    uint32_t operator_type() {
+        return this->header()->operator_type;
+    }
+
+    uint64_t size() {
+        return this->header()->record_count;
+    }
+
+    const TraceRecord* records() {
+        return (const TraceRecord*)(this->data + sizeof(TraceHeader));
+    }
+
+private:
+    TraceHeader* header() {
+        return (TraceHeader*)this->data;
+    }
+
+    char* data = nullptr;
+    size_t length = 0;
+};
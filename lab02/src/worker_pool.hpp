@@ -0,0 +1,185 @@
+#pragma once
+
+#include "affinity.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// A reusable barrier, where the waiting threads spin. The last thread to
+/// arrive runs a completion function and then releases all other threads
+/// at once, like `std::barrier`.
+class SpinBarrier {
+public:
+    template <typename Completion>
+    void wait(int count, Completion on_release) {
+        // The generation can only change, once this thread has arrived
+        uint64_t generation = this->generation.load(std::memory_order_acquire);
+        if (this->arrived.fetch_add(1) + 1 == count) {
+            this->arrived.store(0, std::memory_order_relaxed);
+            on_release();
+            this->generation.store(generation + 1, std::memory_order_release);
+            return;
+        }
+        while (this->generation.load(std::memory_order_acquire) == generation) {
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    std::atomic<int> arrived = 0;
+    std::atomic<uint64_t> generation = 0;
+};
+
+/// The functions a worker of a run calls with its thread id. Only `task` is
+/// timed. `setup` runs before the workers are released and `teardown` once
+/// all of them completed their task, both are optional.
+struct WorkerTask {
+    std::function<void(int)> setup;
+    std::function<void(int)> task;
+    std::function<void(int)> teardown;
+};
+
+/// Worker threads, which are created once and reused for every run. Idle
+/// workers sleep. A run wakes the requested number of workers, which meet
+/// at a `SpinBarrier` and start their task at the same time.
+class WorkerPool {
+public:
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->stop = true;
+        }
+        this->work.notify_all();
+        for (std::thread& thread : this->threads) {
+            thread.join();
+        }
+    }
+
+    /// Runs `task(thread_id)` on `thread_count` workers and waits for all
+    /// of them. Worker `i` is pinned to `cpus[i]`, if `cpus` isn't empty.
+    /// Returns the time in ms from the release of the workers until the
+    /// last one completed its task.
+    double run(int thread_count, std::function<void(int)> task, std::vector<int> cpus = {}) {
+        return this->run(thread_count, WorkerTask { task: task }, cpus);
+    }
+
+    /// Like `run` above, with the per-worker setup and teardown of `task`
+    /// excluded from the returned time.
+    double run(int thread_count, WorkerTask task, std::vector<int> cpus = {}) {
+        std::unique_lock<std::mutex> guard(this->lock);
+        while ((int)this->threads.size() < thread_count) {
+            this->threads.push_back(std::thread(&WorkerPool::worker_thread_func, this, (int)this->threads.size()));
+        }
+
+        this->task = task;
+        this->cpus = cpus;
+        this->active = thread_count;
+        this->remaining = thread_count;
+        this->exiting = thread_count;
+        this->generation += 1;
+        this->work.notify_all();
+
+        this->done.wait(guard, [this] { return this->finished == this->generation; });
+        return std::chrono::duration<double, std::milli>(this->end - this->start).count();
+    }
+
+private:
+    void worker_thread_func(int thread_id) {
+        uint64_t seen = 0;
+        bool is_pinned = false;
+        while (true) {
+            int thread_count;
+            {
+                std::unique_lock<std::mutex> guard(this->lock);
+                this->work.wait(guard, [&] {
+                    return this->stop || (this->generation != seen && thread_id < this->active);
+                });
+                if (this->stop) {
+                    return;
+                }
+                seen = this->generation;
+                thread_count = this->active;
+            }
+
+            if (!this->cpus.empty()) {
+                is_pinned = pin_current_thread(this->cpus[thread_id]);
+            } else if (is_pinned) {
+                unpin_current_thread();
+                is_pinned = false;
+            }
+
+            if (this->task.setup) {
+                this->task.setup(thread_id);
+            }
+            this->barrier.wait(thread_count, [this] {
+                this->start = std::chrono::steady_clock::now();
+            });
+            this->task.task(thread_id);
+
+            // Workers which completed early sleep, instead of taking the
+            // CPU from the ones still timed
+            if (this->remaining.fetch_sub(1) == 1) {
+                this->end = std::chrono::steady_clock::now();
+                {
+                    std::lock_guard<std::mutex> guard(this->lock);
+                    this->completed = seen;
+                }
+                this->tasks_done.notify_all();
+            } else if (this->task.teardown) {
+                std::unique_lock<std::mutex> guard(this->lock);
+                this->tasks_done.wait(guard, [&] { return this->completed == seen; });
+            }
+            if (this->task.teardown) {
+                this->task.teardown(thread_id);
+            }
+
+            if (this->exiting.fetch_sub(1) == 1) {
+                {
+                    std::lock_guard<std::mutex> guard(this->lock);
+                    this->finished = seen;
+                }
+                this->done.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::thread> threads;
+    std::mutex lock;
+    /// Wakes the workers for a new run.
+    std::condition_variable work;
+    /// Wakes the workers waiting for their teardown, once the last one
+    /// completed its task.
+    std::condition_variable tasks_done;
+    /// Wakes `run`, once the last worker completed.
+    std::condition_variable done;
+    bool stop = false;
+
+    /// The current run, only changed while no worker is active.
+    uint64_t generation = 0;
+    /// The last run, where all workers completed their task.
+    uint64_t completed = 0;
+    uint64_t finished = 0;
+    int active = 0;
+    WorkerTask task;
+    std::vector<int> cpus;
+
+    SpinBarrier barrier;
+    /// The workers, which haven't completed their task.
+    std::atomic<int> remaining = 0;
+    /// The workers, which haven't completed their teardown.
+    std::atomic<int> exiting = 0;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point end;
+};
+
+/// The pool shared by all runs of this process.
+WorkerPool& worker_pool() {
+    static WorkerPool pool;
+    return pool;
+}
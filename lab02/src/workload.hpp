@@ -0,0 +1,443 @@
+#pragma once
+
+#include "bench.hpp"
+
+#include <fstream>
+#include <stdexcept>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+    /// A benchmark workload loaded from a spec file. Spec files contain one
+    /// `key = value` pair per line, `#` starts a comment. For example:
+    ///
+    /// ```
+    /// name = read-heavy
+    /// keys = 1024
+    /// ctn = 90
+    /// add = 9
+    /// rmv = 1
+    /// distribution = zipfian
+    /// threads = 1, 2, 4, 8
+    /// ```
+    ///
+    /// A spec with `rates` runs open-loop, once for every offered rate. A
+    /// spec with `duration` runs every configuration for a fixed time. A
+    /// spec with `trace` replays the operations of a trace file instead of
+    /// generating them.
+    /// Missing keys keep the defaults below. See the README for all keys.
+    struct WorkloadSpec {
+        std::string name = "workload";
+        /// The names of the structures to run, all registered structures if empty.
+        std::vector<std::string> structures;
+        /// Arguments are drawn from `[0, keys)`.
+        int keys = 1024;
+        int ctn_weight = 90;
+        /// The add and rmv weights are derived from `ctn_weight` like in
+        /// `BenchConfig`, unless the spec sets both of them.
+        int add_weight = -1;
+        int rmv_weight = -1;
+        KeyDistribution distribution;
+        std::vector<int> threads = {1, 2, 4, 8};
+        int op_count = OP_COUNT;
+        int seed = DEFAULT_GENERATOR_SEED;
+        double prefill = 0.0;
+        /// Prefills every configuration to its steady state, instead of `prefill`.
+        bool steady_prefill = false;
+        /// The run time in ms, zero to perform `op_count` operations per thread.
+        double duration = 0.0;
+        int warmup = WARMUP_RUNS;
+        int repetitions = REPETITIONS;
+        bool latencies = false;
+        bool counters = false;
+        bool memory = false;
+        std::vector<PlacementPolicy> placements = {PlacementNone};
+        /// The offered operations per ms, empty for closed-loop runs.
+        std::vector<double> rates;
+        ArrivalProcess arrival = ArrivalFixed;
+        /// The trace to replay, empty to generate the operations.
+        std::string trace;
+        ReplayMode replay = ReplayOrdered;
+
+        /// Loads the spec from the given file. Errors are printed to `stderr`,
+        /// in which case `false` is returned.
+        bool load(const char* path) {
+            std::ifstream file(path);
+            if (!file.is_open()) {
+                fprintf(stderr, "Failed to open the workload spec `%s`\n", path);
+                return false;
+            }
+
+            std::string line;
+            int line_number = 0;
+            while (std::getline(file, line)) {
+                line_number += 1;
+                line = line.substr(0, line.find('#'));
+                if (trim(line).empty()) {
+                    continue;
+                }
+
+                size_t separator = line.find('=');
+                if (separator == std::string::npos) {
+                    fprintf(stderr, "%s:%d: Expected `key = value`\n", path, line_number);
+                    return false;
+                }
+                std::string key = trim(line.substr(0, separator));
+                std::string value = trim(line.substr(separator + 1));
+                try {
+                    if (!this->set(key, value)) {
+                        fprintf(stderr, "%s:%d: Unknown key `%s`\n", path, line_number, key.c_str());
+                        return false;
+                    }
+                }
+                catch (const std::logic_error& error) {
+                    fprintf(stderr, "%s:%d: Invalid value `%s` for `%s`\n", path, line_number, value.c_str(), key.c_str());
+                    return false;
+                }
+            }
+
+            if ((this->add_weight < 0) != (this->rmv_weight < 0)) {
+                fprintf(stderr, "%s: `add` and `rmv` have to be set together\n", path);
+                return false;
+            }
+            if (this->add_weight >= 0 && this->ctn_weight + this->add_weight + this->rmv_weight != 100) {
+                fprintf(stderr, "%s: `ctn`, `add` and `rmv` have to add up to 100\n", path);
+                return false;
+            }
+            bool positive = this->keys > 0 && this->op_count > 0 && !this->threads.empty();
+            for (int threads : this->threads) {
+                positive &= threads > 0;
+            }
+            positive &= this->warmup >= 0 && this->repetitions > 0 && this->duration >= 0.0;
+            for (double rate : this->rates) {
+                positive &= rate > 0.0;
+            }
+            if (!positive) {
+                fprintf(stderr, "%s: `keys`, `ops`, `threads`, `rates`, `duration` and `repetitions` have to be positive\n", path);
+                return false;
+            }
+            if (this->is_duration() && (this->is_open_loop() || !this->trace.empty())) {
+                fprintf(stderr, "%s: `duration` can't be combined with `rates` or `trace`\n", path);
+                return false;
+            }
+            return true;
+        }
+
+        /// Returns one configuration per thread count and rate.
+        std::vector<BenchConfig> configs() {
+            std::vector<double> rates = this->rates;
+            if (rates.empty()) {
+                rates.push_back(0.0);
+            }
+
+            std::vector<BenchConfig> configs;
+            for (PlacementPolicy placement : this->placements) {
+                for (int threads : this->threads) {
+                    for (double rate : rates) {
+                        BenchConfig config(this->keys, this->ctn_weight, threads, this->distribution);
+                        if (this->add_weight >= 0) {
+                            config.add_weight = this->add_weight;
+                            config.rmv_weight = this->rmv_weight;
+                        }
+                        config.op_count = this->op_count;
+                        config.seed = this->seed;
+                        config.prefill = this->steady_prefill ? config.steady_state_prefill() : this->prefill;
+                        config.duration = this->duration;
+                        config.warmup = this->warmup;
+                        config.repetitions = this->repetitions;
+                        config.latencies = this->latencies;
+                        config.counters = this->counters;
+                        config.memory = this->memory;
+                        config.placement = placement;
+                        config.rate = rate;
+                        config.arrival = this->arrival;
+                        configs.push_back(config);
+                    }
+                }
+            }
+            return configs;
+        }
+
+        bool is_open_loop() {
+            return !this->rates.empty();
+        }
+
+        bool is_duration() {
+            return this->duration > 0.0;
+        }
+
+    private:
+        /// Sets a single key, returns `false` if the key is unknown. Invalid
+        /// numbers and numbers out of range throw a `std::logic_error`.
+        bool set(std::string& key, std::string& value) {
+            if (key == "name") {
+                this->name = value;
+            } else if (key == "structures") {
+                this->structures = split(value);
+            } else if (key == "keys") {
+                this->keys = std::stoi(value);
+            } else if (key == "ctn") {
+                this->ctn_weight = parse_weight(value);
+            } else if (key == "add") {
+                this->add_weight = parse_weight(value);
+            } else if (key == "rmv") {
+                this->rmv_weight = parse_weight(value);
+            } else if (key == "distribution") {
+                return this->set_distribution(value);
+            } else if (key == "theta") {
+                // The zipfian constants divide by `1 - theta`
+                this->distribution.theta = parse_range(value, 0.0, 1.0, true);
+            } else if (key == "hot_set") {
+                this->distribution.hot_set = parse_range(value, 0.0, 1.0);
+            } else if (key == "hot_ops") {
+                this->distribution.hot_ops = parse_range(value, 0.0, 1.0);
+            } else if (key == "threads") {
+                this->threads.clear();
+                for (std::string& threads : split(value)) {
+                    this->threads.push_back(std::stoi(threads));
+                }
+            } else if (key == "ops") {
+                this->op_count = std::stoi(value);
+            } else if (key == "seed") {
+                this->seed = std::stoi(value);
+            } else if (key == "warmup") {
+                this->warmup = std::stoi(value);
+            } else if (key == "repetitions") {
+                this->repetitions = std::stoi(value);
+            } else if (key == "placement") {
+                this->placements.clear();
+                for (std::string& name : split(value)) {
+                    this->placements.push_back(parse_placement(name));
+                }
+            } else if (key == "latencies") {
+                this->latencies = parse_bool(value);
+            } else if (key == "counters") {
+                this->counters = parse_bool(value);
+            } else if (key == "memory") {
+                this->memory = parse_bool(value);
+            } else if (key == "prefill") {
+                this->steady_prefill = value == "steady";
+                if (!this->steady_prefill) {
+                    this->prefill = parse_range(value, 0.0, 1.0);
+                }
+            } else if (key == "duration") {
+                this->duration = std::stod(value);
+            } else if (key == "rates") {
+                this->rates.clear();
+                for (std::string& rate : split(value)) {
+                    this->rates.push_back(std::stod(rate));
+                }
+            } else if (key == "trace") {
+                this->trace = value;
+            } else if (key == "replay") {
+                if (value == "ordered") {
+                    this->replay = ReplayOrdered;
+                } else if (value == "timed") {
+                    this->replay = ReplayTimed;
+                } else {
+                    throw std::invalid_argument(value);
+                }
+            } else if (key == "arrival") {
+                if (value == "fixed") {
+                    this->arrival = ArrivalFixed;
+                } else if (value == "poisson") {
+                    this->arrival = ArrivalPoisson;
+                } else {
+                    throw std::invalid_argument(value);
+                }
+            } else {
+                return false;
+            }
+            return true;
+        }
+
+        /// Only changes the type, since the parameters might be set before.
+        bool set_distribution(std::string& value) {
+            const std::pair<char const*, KeyDistributionType> types[] = {
+                {"uniform", KeyUniform},
+                {"zipfian", KeyZipfian},
+                {"hotspot", KeyHotspot},
+                {"sequential", KeySequential},
+                {"latest", KeyLatest},
+            };
+            for (auto [name, type] : types) {
+                if (value == name) {
+                    this->distribution.type = type;
+                    return true;
+                }
+            }
+            throw std::invalid_argument(value);
+        }
+
+        static PlacementPolicy parse_placement(std::string& value) {
+            const PlacementPolicy policies[] = {PlacementNone, PlacementCompact, PlacementScatter, PlacementSmt};
+            for (PlacementPolicy policy : policies) {
+                if (value == placement_name(policy)) {
+                    return policy;
+                }
+            }
+            throw std::invalid_argument(value);
+        }
+
+        /// Parses a number in `[min, max]`, or in `(min, max)` if `exclusive`.
+        static double parse_range(std::string& value, double min, double max, bool exclusive = false) {
+            double number = std::stod(value);
+            bool in_range = exclusive
+                ? number > min && number < max
+                : number >= min && number <= max;
+            if (!in_range) {
+                throw std::out_of_range(value);
+            }
+            return number;
+        }
+
+        /// Parses an operator weight, a percentage in `[0, 100]`. A
+        /// negative weight would otherwise pass as unset or balance an
+        /// oversized one in the sum.
+        static int parse_weight(std::string& value) {
+            int weight = std::stoi(value);
+            if (weight < 0 || weight > 100) {
+                throw std::out_of_range(value);
+            }
+            return weight;
+        }
+
+        static bool parse_bool(std::string& value) {
+            if (value == "yes" || value == "true") {
+                return true;
+            } else if (value == "no" || value == "false") {
+                return false;
+            }
+            throw std::invalid_argument(value);
+        }
+
+        static std::string trim(std::string text) {
+            size_t start = text.find_first_not_of(" \t\r");
+            if (start == std::string::npos) {
+                return "";
+            }
+            size_t end = text.find_last_not_of(" \t\r");
+            return text.substr(start, end - start + 1);
+        }
+
+        /// Splits a comma separated list.
+        static std::vector<std::string> split(std::string& text) {
+            std::vector<std::string> items;
+            size_t start = 0;
+            while (start <= text.size()) {
+                size_t end = text.find(',', start);
+                if (end == std::string::npos) {
+                    end = text.size();
+                }
+                std::string item = trim(text.substr(start, end - start));
+                if (!item.empty()) {
+                    items.push_back(item);
+                }
+                start = end + 1;
+            }
+            return items;
+        }
+    };
+
+    /// A data structure, which can be benchmarked with workload specs.
+    struct RegisteredStructure {
+        std::string name;
+        /// Runs a single configuration and prints the table row.
+        void (*run)(char const* name, BenchConfig& config);
+        /// Replays a trace and prints the table row.
+        void (*replay)(char const* name, TraceReader* trace, ReplayMode mode);
+        /// The operator type of the traces, which can be replayed.
+        uint32_t operator_type;
+    };
+
+    /// The structures available to `run_workload`, see `register_structure`.
+    std::vector<RegisteredStructure>& structure_registry() {
+        static std::vector<RegisteredStructure> structures;
+        return structures;
+    }
+
+    /// Registers `DS` under the given name. `Op` selects the operators,
+    /// which the operation mix of a workload is mapped to.
+    template <class DS, typename Op = SetOperator>
+    void register_structure(char const* name) {
+        structure_registry().push_back(RegisteredStructure{
+            name,
+            run_config<DS, Op>,
+            run_replay<DS, Op>,
+            trace_operator_type(Op())
+        });
+    }
+
+    /// Replays the trace of the spec for all selected structures, which
+    /// support its operator type.
+    bool replay_workload(WorkloadSpec& spec, std::vector<RegisteredStructure*>& selected) {
+        TraceReader trace(spec.trace.c_str());
+        if (!trace.is_valid()) {
+            return false;
+        }
+
+        std::vector<RegisteredStructure*> supported;
+        for (RegisteredStructure* structure : selected) {
+            if (structure->operator_type == trace.operator_type()) {
+                supported.push_back(structure);
+            }
+        }
+        if (supported.empty()) {
+            fprintf(stderr, "No selected structure supports the operations of `%s`\n", spec.trace.c_str());
+            return false;
+        }
+
+        print_replay_header();
+        for (RegisteredStructure* structure : supported) {
+            structure->replay(structure->name.c_str(), &trace, spec.replay);
+        }
+        return true;
+    }
+
+    /// Runs every configuration of the spec for all selected structures.
+    /// Returns `false`, if the spec names an unknown structure.
+    bool run_workload(WorkloadSpec& spec) {
+        std::vector<RegisteredStructure*> selected;
+        for (RegisteredStructure& structure : structure_registry()) {
+            if (spec.structures.empty()) {
+                selected.push_back(&structure);
+            }
+        }
+        for (std::string& name : spec.structures) {
+            bool found = false;
+            for (RegisteredStructure& structure : structure_registry()) {
+                if (structure.name == name) {
+                    selected.push_back(&structure);
+                    found = true;
+                }
+            }
+            if (!found) {
+                fprintf(stderr, "The workload `%s` uses the unknown structure `%s`\n", spec.name.c_str(), name.c_str());
+                return false;
+            }
+        }
+
+        if (!spec.trace.empty()) {
+            return replay_workload(spec, selected);
+        }
+
+        std::vector<BenchConfig> configs = spec.configs();
+        if (spec.is_open_loop()) {
+            print_open_loop_header();
+        } else if (spec.is_duration()) {
+            print_duration_header();
+        } else {
+            print_table_header();
+        }
+        for (RegisteredStructure* structure : selected) {
+            for (BenchConfig& config : configs) {
+                structure->run(structure->name.c_str(), config);
+            }
+        }
+        // The next workload hardly reuses any tapes
+        clear_tapes();
+        return true;
+    }
+}
@@ -0,0 +1,4 @@
+# Replays the trace recorded by task 8 with the original timing.
+name = replay
+trace = multiset.trace
+replay = timed
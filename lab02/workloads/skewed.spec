@@ -0,0 +1,12 @@
+# A read-mostly workload, where a few keys receive most operations.
+name = skewed
+keys = 1024
+prefill = 0.5
+ctn = 80
+add = 10
+rmv = 10
+distribution = zipfian
+theta = 0.99
+threads = 1, 2, 4, 8, 16
+ops = 2000
+latencies = yes
@@ -0,0 +1,11 @@
+# Only updates, which keeps the structures busy with locking.
+name = write-heavy
+keys = 1024
+prefill = 0.5
+ctn = 0
+add = 50
+rmv = 50
+distribution = uniform
+threads = 1, 2, 4, 8, 16
+ops = 2000
+latencies = yes
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/// The sysfs directory describing the CPUs.
+#define SYSFS_CPU_PATH "/sys/devices/system/cpu"
+
+/// Where the worker threads of a benchmark are placed.
+enum PlacementPolicy {
+    /// The threads aren't pinned, the scheduler places them.
+    PlacementNone = 1,
+    /// One thread per core of the first package, then the SMT siblings of
+    /// its cores, then the next package.
+    PlacementCompact = 2,
+    /// One thread per core, alternating between the packages. SMT
+    /// siblings are only used, once every core has a thread.
+    PlacementScatter = 3,
+    /// Both SMT siblings of a core, before the next core is used.
+    PlacementSmt = 4,
+};
+
+char const* placement_name(PlacementPolicy policy) {
+    switch (policy) {
+        case PlacementCompact:
+            return "compact";
+        case PlacementScatter:
+            return "scatter";
+        case PlacementSmt:
+            return "smt";
+        default:
+            return "none";
+    }
+}
+
+/// A hardware thread, as described by sysfs.
+struct CpuInfo {
+    int cpu;
+    int package;
+    int core;
+    /// The index of the hardware thread within its core.
+    int smt;
+};
+
+/// Reads a single integer from a sysfs file, or returns `fallback`.
+int read_sysfs_int(std::string path, int fallback) {
+    std::ifstream file(path);
+    int value;
+    if (file >> value) {
+        return value;
+    }
+    return fallback;
+}
+
+/// Returns the CPUs this process may run on, with their position in the
+/// topology. Without sysfs, every CPU is treated as its own core.
+std::vector<CpuInfo>& cpu_topology() {
+    static std::vector<CpuInfo> cpus;
+    if (!cpus.empty()) {
+        return cpus;
+    }
+
+    std::vector<int> allowed;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                allowed.push_back(cpu);
+            }
+        }
+    }
+#endif
+    if (allowed.empty()) {
+        for (int cpu = 0; cpu < (int)std::max(1u, std::thread::hardware_concurrency()); cpu++) {
+            allowed.push_back(cpu);
+        }
+    }
+
+    std::map<std::pair<int, int>, int> threads_per_core;
+    for (int cpu : allowed) {
+        std::string topology = SYSFS_CPU_PATH "/cpu" + std::to_string(cpu) + "/topology/";
+        CpuInfo info;
+        info.cpu = cpu;
+        info.package = read_sysfs_int(topology + "physical_package_id", 0);
+        info.core = read_sysfs_int(topology + "core_id", cpu);
+        info.smt = threads_per_core[{info.package, info.core}]++;
+        cpus.push_back(info);
+    }
+    return cpus;
+}
+
+/// Returns the CPU of every worker thread for the given policy. Threads
+/// wrap around, if there are more threads than CPUs. The result is empty
+/// for `PlacementNone`.
+std::vector<int> placement_cpus(PlacementPolicy policy, int thread_count) {
+    if (policy == PlacementNone) {
+        return {};
+    }
+
+    std::vector<CpuInfo> order = cpu_topology();
+    if (policy == PlacementScatter) {
+        // The n-th core of every package comes before the (n+1)-th core
+        std::map<int, int> cores_seen;
+        std::map<std::pair<int, int>, int> core_rank;
+        for (CpuInfo& info : order) {
+            if (info.smt == 0) {
+                core_rank[{info.package, info.core}] = cores_seen[info.package]++;
+            }
+        }
+        std::stable_sort(order.begin(), order.end(), [&](const CpuInfo& a, const CpuInfo& b) {
+            int rank_a = core_rank[{a.package, a.core}];
+            int rank_b = core_rank[{b.package, b.core}];
+            return std::tie(a.smt, rank_a, a.package) < std::tie(b.smt, rank_b, b.package);
+        });
+    } else {
+        std::stable_sort(order.begin(), order.end(), [&](const CpuInfo& a, const CpuInfo& b) {
+            if (policy == PlacementSmt) {
+                return std::tie(a.package, a.core, a.smt) < std::tie(b.package, b.core, b.smt);
+            }
+            return std::tie(a.package, a.smt, a.core) < std::tie(b.package, b.smt, b.core);
+        });
+    }
+
+    std::vector<int> cpus;
+    for (int thread = 0; thread < thread_count; thread++) {
+        cpus.push_back(order[thread % order.size()].cpu);
+    }
+    return cpus;
+}
+
+/// Pins the calling thread to a single CPU. Failures are reported once, in
+/// which case `false` is returned.
+bool pin_current_thread(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+        return true;
+    }
+#endif
+    static std::atomic<bool> reported = false;
+    if (!reported.exchange(true)) {
+        fprintf(stderr, "Failed to pin a thread to CPU %d, the threads run unpinned\n", cpu);
+    }
+    return false;
+}
+
+/// Allows the calling thread to run on every CPU of the process again.
+void unpin_current_thread() {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (CpuInfo& info : cpu_topology()) {
+        CPU_SET(info.cpu, &set);
+    }
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/// The retirements of a thread, after which it tries to advance the epoch.
+#define EPOCH_ADVANCE_INTERVAL 64
+
+/// The epoch of a thread, which isn't pinned.
+const uint64_t EPOCH_INACTIVE = UINT64_MAX;
+
+/// A pointer retired by [`epoch_retire`], with the function freeing it.
+struct RetiredPointer {
+    void* pointer;
+    void (*free)(void*);
+};
+
+/// The pointers retired by a thread during one epoch.
+struct RetiredList {
+    uint64_t epoch = 0;
+    std::vector<RetiredPointer> pointers;
+
+    void free_all() {
+        for (RetiredPointer& retired : this->pointers) {
+            retired.free(retired.pointer);
+        }
+        this->pointers.clear();
+    }
+};
+
+/// The state of a single thread, registered for its lifetime. Only the
+/// thread itself writes `epoch` and accesses its retired lists. The struct
+/// is aligned to a cache line, so that pinning doesn't cause false sharing.
+struct alignas(64) ThreadEpoch {
+    /// The epoch observed by the thread when it was pinned.
+    std::atomic<uint64_t> epoch = EPOCH_INACTIVE;
+    /// The pointers retired in the last three epochs, indexed by `epoch % 3`.
+    RetiredList retired[3];
+    int retirements = 0;
+
+    ThreadEpoch();
+    ~ThreadEpoch();
+};
+
+/// The global epoch and all registered threads. A pointer retired in epoch
+/// `e` is freed once the global epoch reached `e + 2`. The epoch only
+/// advances, when every pinned thread observed the current epoch, so no
+/// thread can still hold a pointer, which was retired two epochs ago.
+struct EpochDomain {
+    alignas(64) std::atomic<uint64_t> epoch = 0;
+    /// Protects `threads` and `orphans`, and serializes advancing the epoch.
+    alignas(64) std::mutex lock;
+    std::vector<ThreadEpoch*> threads;
+    /// The retired pointers of threads, which already exited.
+    std::vector<RetiredList> orphans;
+};
+
+/// The domain is never destroyed, since threads might still exit after the
+/// static destructors ran.
+EpochDomain& epoch_domain() {
+    static EpochDomain* domain = new EpochDomain;
+    return *domain;
+}
+
+ThreadEpoch::ThreadEpoch() {
+    EpochDomain& domain = epoch_domain();
+    std::lock_guard<std::mutex> guard(domain.lock);
+    domain.threads.push_back(this);
+}
+
+ThreadEpoch::~ThreadEpoch() {
+    EpochDomain& domain = epoch_domain();
+    std::lock_guard<std::mutex> guard(domain.lock);
+    for (RetiredList& list : this->retired) {
+        if (!list.pointers.empty()) {
+            domain.orphans.push_back(std::move(list));
+        }
+    }
+    std::erase(domain.threads, this);
+}
+
+/// Returns the state of the calling thread.
+ThreadEpoch& thread_epoch() {
+    thread_local ThreadEpoch epoch;
+    return epoch;
+}
+
+/// Advances the global epoch, if every pinned thread observed it. This
+/// gives up instead of waiting, if another thread is advancing it.
+bool epoch_try_advance() {
+    EpochDomain& domain = epoch_domain();
+    std::unique_lock<std::mutex> guard(domain.lock, std::try_to_lock);
+    if (!guard.owns_lock()) {
+        return false;
+    }
+
+    uint64_t epoch = domain.epoch.load();
+    for (ThreadEpoch* thread : domain.threads) {
+        uint64_t observed = thread->epoch.load();
+        if (observed != EPOCH_INACTIVE && observed != epoch) {
+            return false;
+        }
+    }
+    domain.epoch.store(epoch + 1);
+
+    std::erase_if(domain.orphans, [&](RetiredList& list) {
+        if (list.epoch + 2 > epoch + 1) {
+            return false;
+        }
+        list.free_all();
+        return true;
+    });
+    return true;
+}
+
+/// Marks the calling thread as reading shared pointers. Pointers retired
+/// from now on aren't freed until the thread is unpinned.
+void epoch_pin() {
+    ThreadEpoch& thread = thread_epoch();
+    EpochDomain& domain = epoch_domain();
+    uint64_t epoch = domain.epoch.load();
+    while (true) {
+        thread.epoch.store(epoch);
+        // The epoch might have advanced before the store was visible
+        uint64_t current = domain.epoch.load();
+        if (current == epoch) {
+            return;
+        }
+        epoch = current;
+    }
+}
+
+void epoch_unpin() {
+    thread_epoch().epoch.store(EPOCH_INACTIVE, std::memory_order_release);
+}
+
+/// Pins the calling thread for the lifetime of the guard.
+struct EpochGuard {
+    EpochGuard() {
+        epoch_pin();
+    }
+
+    ~EpochGuard() {
+        epoch_unpin();
+    }
+
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+};
+
+/// Frees the pointer with `delete`, once no pinned thread can read it
+/// anymore. The pointer has to be unreachable for threads, which pin
+/// themselves afterwards. Every thread retires into its own lists, the
+/// only shared write is the rare advance of the epoch.
+template<typename T>
+void epoch_retire(T* pointer) {
+    ThreadEpoch& thread = thread_epoch();
+    uint64_t epoch = epoch_domain().epoch.load();
+
+    RetiredList& list = thread.retired[epoch % 3];
+    if (list.epoch != epoch) {
+        // The list is from epoch - 3 or older
+        list.free_all();
+        list.epoch = epoch;
+    }
+    list.pointers.push_back(RetiredPointer {
+        pointer: pointer,
+        free: [](void* retired) { delete (T*)retired; },
+    });
+
+    thread.retirements += 1;
+    if (thread.retirements % EPOCH_ADVANCE_INTERVAL == 0 && epoch_try_advance()) {
+        epoch += 1;
+        for (RetiredList& retired : thread.retired) {
+            if (retired.epoch + 2 <= epoch) {
+                retired.free_all();
+            }
+        }
+    }
+}
@@ -2,6 +2,7 @@
 
 #include "adt.hpp"
 #include "monitoring.hpp"
+#include "instrument.hpp"
 
 const uintptr_t FLAG_MASK = 0x00000001;
 const uintptr_t PTR_MASK = ~FLAG_MASK;
@@ -118,18 +119,24 @@ private:
         std::tie(succ, mark) = curr->next.get();
 
         while (mark) {
+          PHASE_MARK(PhaseTraversal);
           bool snip = pred->next.cas(curr, succ, false, false);
+          PHASE_MARK(PhaseReclamation);
 
           // Retry if CAS fails
-          if (!snip)
+          if (!snip) {
+            INSTRUMENT_COUNT(ContentionSnipFailures);
             break;
+          }
 
           curr = succ;
           std::tie(succ, mark) = curr->next.get();
         }
 
-        if (curr->value >= key) // Found the appropriate window
+        if (curr->value >= key) { // Found the appropriate window
+          PHASE_MARK(PhaseTraversal);
           return LockFreeWindow(pred, curr);
+        }
         pred = curr;
         curr = succ;
       }
@@ -163,6 +170,7 @@ public:
     bool result = false;
     // A02: Add code to insert the element into the set and update `result`.
 
+    PHASE_BEGIN();
     while (true) {
       LockFreeWindow window = find(value);
       LockFreeSetNode *pred = window.pred;
@@ -171,10 +179,14 @@ public:
         break;
       } else {
         LockFreeSetNode *node = new LockFreeSetNode(value, curr);
-        if (pred->next.cas(curr, node, false, false)) {
+        PHASE_MARK(PhaseAllocation);
+        bool inserted = pred->next.cas(curr, node, false, false);
+        PHASE_MARK(PhaseLinearization);
+        if (inserted) {
           result = true;
           break;
         }
+        INSTRUMENT_COUNT(ContentionCasFailures);
       }
     }
     return result;
@@ -185,6 +197,7 @@ public:
     // A02: Add code to remove the element from the set and update `result`.
 
     bool snip = false;
+    PHASE_BEGIN();
     while (true) {
       LockFreeWindow window = find(value);
       LockFreeSetNode *pred = window.pred;
@@ -197,8 +210,11 @@ public:
       } else {
         std::tie(succ, mark) = curr->next.get();
         snip = curr->next.try_set_mark(succ);
-        if (!snip)
+        PHASE_MARK(PhaseLinearization);
+        if (!snip) {
+          INSTRUMENT_COUNT(ContentionCasFailures);
           break;
+        }
         result = true;
         break;
       }
@@ -208,11 +224,15 @@ public:
 
   bool ctn(int value) override {
     // A02: Add code to check if the element is in the set and update `result`.
+    PHASE_BEGIN();
     LockFreeSetNode *curr = this->head;
     bool mark = false;
 
     while (curr->value < value)
-      std::tie(curr, mark) = curr->next.get();
+      curr = curr->next.get_ptr();
+    // The mark stored in the next pointer of `curr` marks `curr` as removed
+    mark = curr->next.get_flag();
+    PHASE_MARK(PhaseTraversal);
     return (curr->value == value && !mark);
   }
 
@@ -6,14 +6,39 @@
 #include "std_stack.hpp"
 #include "treiber_stack.hpp"
 #include "lock_free_set.hpp"
+#include "trace.hpp"
+#include "workload.hpp"
 
 #include <stdio.h>
+#include <cmath>
 #include <cstring>
+#include <functional>
 #include <iostream>
 
 #define OPERATION_COUNT 2000
 #define DEFAULT_GENERATOR_SEED 0
 #define DEFAULT_OP_MOD 128
+#define TRACE_FILE "stack.trace"
+#define HISTORY_TRACE_FILE "stack_history.trace"
+#define OVERFLOW_RING_CAPACITY 16
+
+/// Throughput drops above this percentage fail the comparison task.
+#define DEFAULT_REGRESSION_THRESHOLD 5.0
+
+/// The keys and draws of the key distribution tests.
+#define KEY_HISTOGRAM_KEYS 64
+#define KEY_HISTOGRAM_DRAWS 200000
+/// The allowed deviation from the expected frequency of a key.
+#define KEY_HISTOGRAM_TOLERANCE 0.1
+
+/// The workloads run by the workload task, if no spec files are given.
+const char* DEFAULT_WORKLOADS[] = {
+    "workloads/read_heavy.spec",
+    "workloads/write_heavy.spec",
+    "workloads/skewed.spec",
+    "workloads/open_loop.spec",
+    "workloads/steady.spec",
+};
 
 const std::vector<OpWeights<SetOperator>> DEFAULT_SET_GEN_WEIGHTS = {
     OpWeights<SetOperator> {op: SetOperator::Add, weight: 3},
@@ -28,9 +53,15 @@ const std::vector<OpWeights<StackOperator>> DEFAULT_STACK_GEN_WEIGHTS = {
 };
 
 template <typename Stack>
-bool run_stack_n_threads(int thread_count, int op_arg_mod, int seed = DEFAULT_GENERATOR_SEED) {
+bool run_stack_n_threads(
+    int thread_count,
+    int op_arg_mod,
+    int seed = DEFAULT_GENERATOR_SEED,
+    TraceWriter* trace = nullptr
+) {
     StdStack test_stack;
-    EventMonitor<Stack, StdStack, StackOperator> monitor(&test_stack);
+    StackMonitor monitor(&test_stack);
+    monitor.set_trace_writer(trace);
     OpGenerator<StackOperator> generator(
         DEFAULT_STACK_GEN_WEIGHTS,
         OPERATION_COUNT,
@@ -40,7 +71,7 @@ bool run_stack_n_threads(int thread_count, int op_arg_mod, int seed = DEFAULT_GE
     Stack stack(&monitor);
     monitor.set_concurrent_data_structure(&stack);
 
-    return run_data_structure_n_threads_with_monitor<Stack, StdStack, StackOperator>(
+    return run_data_structure_n_threads_with_monitor(
         &stack,
         &generator,
         &monitor,
@@ -48,13 +79,64 @@ bool run_stack_n_threads(int thread_count, int op_arg_mod, int seed = DEFAULT_GE
     );
 }
 
+/// Runs the stack with a tiny monitor queue, to test the overflow policy.
+template <typename Stack>
+bool run_stack_with_overflow(int thread_count, int op_arg_mod, OverflowPolicy policy) {
+    StdStack test_stack;
+    StackMonitor monitor(&test_stack);
+    monitor.set_overflow_policy(policy, OVERFLOW_RING_CAPACITY);
+    OpGenerator<StackOperator> generator(
+        DEFAULT_STACK_GEN_WEIGHTS,
+        OPERATION_COUNT,
+        op_arg_mod,
+        DEFAULT_GENERATOR_SEED
+    );
+    Stack stack(&monitor);
+    monitor.set_concurrent_data_structure(&stack);
+
+    return run_data_structure_n_threads_with_monitor(&stack, &generator, &monitor, thread_count);
+}
+
+/// Records the histories of the stack without a monitor, writes them into a
+/// trace and checks that the histories read back from the trace get the
+/// same verdict as the recorded ones.
+template <typename Stack>
+bool test_history_trace(int thread_count, int op_arg_mod) {
+    OpGenerator<StackOperator> generator(DEFAULT_STACK_GEN_WEIGHTS, OPERATION_COUNT, op_arg_mod, DEFAULT_GENERATOR_SEED);
+    Stack stack;
+    std::vector<ThreadHistory<StackOperator>> histories = record_histories<Stack, StackOperator>(&stack, &generator, thread_count);
+    bool verdict = check_histories<StdStack, StackOperator>(histories);
+
+    TraceWriter writer(HISTORY_TRACE_FILE, trace_operator_type(StackOperator()));
+    if (!writer.is_open()) {
+        return false;
+    }
+    write_histories(&writer, histories);
+    writer.close();
+
+    TraceReader reader(HISTORY_TRACE_FILE);
+    if (!reader.is_valid()) {
+        return false;
+    }
+    std::vector<ThreadHistory<StackOperator>> read = read_histories<StackOperator>(&reader);
+    return check_histories<StdStack, StackOperator>(read) == verdict;
+}
+
+/// Runs the stack without a monitor and checks the recorded histories.
+template <typename Stack>
+bool run_stack_n_threads_with_history(int thread_count, int op_arg_mod) {
+    OpGenerator<StackOperator> generator(DEFAULT_STACK_GEN_WEIGHTS, OPERATION_COUNT, op_arg_mod, DEFAULT_GENERATOR_SEED);
+    Stack stack;
+
+    return run_data_structure_n_threads_with_history<Stack, StdStack, StackOperator>(&stack, &generator, thread_count);
+}
+
 template <typename Set>
-void run_set_n_threads(int thread_count, int op_arg_mod) {
-    StdSet test_set;
+bool run_set_n_threads(int thread_count, int op_arg_mod) {
     OpGenerator<SetOperator> generator(DEFAULT_SET_GEN_WEIGHTS, OPERATION_COUNT, op_arg_mod, DEFAULT_GENERATOR_SEED);
     Set set;
 
-    run_data_structure_n_threads<Set, SetOperator>(&set, &generator, thread_count);
+    return run_data_structure_n_threads_with_history<Set, StdSet, SetOperator>(&set, &generator, thread_count);
 }
 
 
@@ -111,9 +193,7 @@ bool test_set_implementation(char const* set_name) {
     std::cout << std::endl;
 
     std::cout << "## Running `"<< set_name <<"` with 8 thread" << std::endl;
-    run_set_n_threads<Set>(8, DEFAULT_OP_MOD);
-    std::cout << "This multithreaded test doesn't validate the state." << std::endl;
-    std::cout << "If it didn't crash it's probably fine." << std::endl;
+    valid &= run_set_n_threads<Set>(8, DEFAULT_OP_MOD);
     std::cout << std::endl;
 
     if (valid) {
@@ -128,12 +208,12 @@ int task_1() {
     std::cout << "# Task 1: `TreiberStack`" << std::endl;
 
     std::cout << "## Testing `TreiberStack` with 1 thread" << std::endl;
-    valid &= run_stack_n_threads<TreiberStack>(16, DEFAULT_OP_MOD);
+    valid &= run_stack_n_threads<TreiberStack<StackMonitor>>(16, DEFAULT_OP_MOD);
     std::cout << std::endl;
 
     for (int test_run = 0; test_run < 8; test_run++) {
         std::cout << "## Testing `TreiberStack` with 16 thread and seed: " << test_run << std::endl;
-        valid &= run_stack_n_threads<TreiberStack>(16, DEFAULT_OP_MOD, test_run);
+        valid &= run_stack_n_threads<TreiberStack<StackMonitor>>(16, DEFAULT_OP_MOD, test_run);
         std::cout << std::endl;
 
         if (!valid) {
@@ -141,6 +221,21 @@ int task_1() {
         }
     }
 
+    std::cout << "## Testing `TreiberStack` with 16 thread, without a monitor" << std::endl;
+    valid &= run_stack_n_threads_with_history<TreiberStack<>>(16, DEFAULT_OP_MOD);
+    std::cout << std::endl;
+
+    const std::pair<OverflowPolicy, char const*> policies[] = {
+        {OverflowBlock, "blocking"},
+        {OverflowSpill, "spilling"},
+    };
+    for (auto [policy, policy_name] : policies) {
+        std::cout << "## Testing `TreiberStack` with 16 thread, " << policy_name
+            << " once " << OVERFLOW_RING_CAPACITY << " events are queued" << std::endl;
+        valid &= run_stack_with_overflow<TreiberStack<StackMonitor>>(16, DEFAULT_OP_MOD, policy);
+        std::cout << std::endl;
+    }
+
     if (valid) {
         return 0;
     } else {
@@ -166,6 +261,175 @@ int task_3() {
     return 0;
 }
 
+int task_4() {
+    std::cout << "# Task 4: Monitor benchmarking" << std::endl;
+    std::cout << std::endl;
+
+    bench::benchmark_monitor();
+
+    return 0;
+}
+
+int task_5() {
+    bool valid = true;
+    std::cout << "# Task 5: Trace recording" << std::endl;
+
+    {
+        std::cout << "## Recording `TreiberStack` with 16 thread into `" << TRACE_FILE << "`" << std::endl;
+        TraceWriter trace(TRACE_FILE, trace_operator_type(StackOperator()));
+        valid &= trace.is_open();
+        valid &= run_stack_n_threads<TreiberStack<StackMonitor>>(16, DEFAULT_OP_MOD, DEFAULT_GENERATOR_SEED, &trace);
+        trace.close();
+        std::cout << "Recorded " << trace.size() << " events" << std::endl;
+        std::cout << std::endl;
+    }
+
+    {
+        std::cout << "## Replaying `" << TRACE_FILE << "`" << std::endl;
+        TraceReader trace(TRACE_FILE);
+        StdStack test_stack;
+        valid &= trace.is_valid() && test_trace<StdStack, StackOperator>(&test_stack, &trace);
+        if (valid) {
+            std::cout << "Successfully replayed " << trace.size() << " events" << std::endl;
+        }
+        std::cout << std::endl;
+    }
+
+    {
+        std::cout << "## Recording the history of `TreiberStack` with 16 thread into `" << HISTORY_TRACE_FILE << "`" << std::endl;
+        valid &= test_history_trace<TreiberStack<>>(16, DEFAULT_OP_MOD);
+        std::cout << std::endl;
+    }
+
+    if (valid) {
+        return 0;
+    } else {
+        return -1;
+    }
+}
+
+int task_6() {
+    std::cout << "# Task 6: Monitor overhead" << std::endl;
+    std::cout << std::endl;
+
+    bench::benchmark_monitor_overhead<TreiberStack, StackMonitor, StdStack, StackOperator>("TreiberStack");
+
+    return 0;
+}
+
+int task_7(int spec_count, char* specs[]) {
+    std::cout << "# Task 7: Workload benchmarking" << std::endl;
+    std::cout << std::endl;
+
+    bench::register_structure<LockFreeSet>("LockFreeSet");
+    bench::register_structure<TreiberStack<>, StackOperator>("TreiberStack");
+
+    std::vector<const char*> paths(specs, specs + spec_count);
+    if (paths.empty()) {
+        paths.assign(std::begin(DEFAULT_WORKLOADS), std::end(DEFAULT_WORKLOADS));
+    }
+
+    for (const char* path : paths) {
+        bench::WorkloadSpec spec;
+        if (!spec.load(path)) {
+            return -1;
+        }
+        std::cout << "## Workload `" << spec.name << "` from `" << path << "`" << std::endl;
+        if (!bench::run_workload(spec)) {
+            return -1;
+        }
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
+
+int task_8(int argc, char* argv[]) {
+    std::cout << "# Task 8: Benchmark comparison" << std::endl;
+    std::cout << std::endl;
+
+    if (argc < 2) {
+        fprintf(stderr, "Please pass the old and the new results file, and optionally a threshold in percent\n");
+        return -1;
+    }
+    double threshold = DEFAULT_REGRESSION_THRESHOLD;
+    if (argc > 2) {
+        try {
+            threshold = std::stod(argv[2]);
+        }
+        catch (const std::invalid_argument& ia) {
+            fprintf(stderr, "The threshold has to be a number\n");
+            return -1;
+        }
+    }
+
+    int regressions = bench::compare_results(argv[0], argv[1], threshold);
+    if (regressions != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/// Draws keys from the distribution and checks that every key is drawn with
+/// the frequency returned by `expected`.
+bool test_key_histogram(KeyDistribution distribution, std::function<double(int)> expected) {
+    std::vector<OpWeights<SetOperator>> weights = {
+        OpWeights<SetOperator> {op: SetOperator::Contains, weight: 1},
+    };
+    OpGenerator<SetOperator> generator(
+        weights,
+        KEY_HISTOGRAM_DRAWS,
+        KEY_HISTOGRAM_KEYS,
+        DEFAULT_GENERATOR_SEED,
+        distribution
+    );
+    std::vector<int> counts(KEY_HISTOGRAM_KEYS, 0);
+    OpStream<SetOperator> stream = generator.stream(0);
+    while (auto operation = stream.next()) {
+        counts[operation.value().argument] += 1;
+    }
+
+    for (int key = 0; key < KEY_HISTOGRAM_KEYS; key++) {
+        double frequency = (double)counts[key] / KEY_HISTOGRAM_DRAWS;
+        if (std::abs(frequency - expected(key)) > KEY_HISTOGRAM_TOLERANCE * expected(key)) {
+            std::cout << "Key " << key << " was drawn with a frequency of " << frequency
+                << " instead of " << expected(key) << std::endl;
+            return false;
+        }
+    }
+    std::cout << "Successfully drew " << KEY_HISTOGRAM_DRAWS << " keys" << std::endl;
+    return true;
+}
+
+int task_9() {
+    bool valid = true;
+    std::cout << "# Task 9: Key distributions" << std::endl;
+    std::cout << std::endl;
+
+    double n = KEY_HISTOGRAM_KEYS;
+    {
+        std::cout << "## Drawing `hotspot(0.25, 0.8)`" << std::endl;
+        valid &= test_key_histogram(KeyDistribution::hotspot(0.25, 0.8), [&](int key) {
+            return key < n * 0.25 ? 0.8 / (n * 0.25) : 0.2 / (n * 0.75);
+        });
+        std::cout << std::endl;
+    }
+
+    {
+        std::cout << "## Drawing `hotspot(1.0, 0.8)`, where every key is hot" << std::endl;
+        valid &= test_key_histogram(KeyDistribution::hotspot(1.0, 0.8), [&](int) {
+            return 1.0 / n;
+        });
+        std::cout << std::endl;
+    }
+
+    if (valid) {
+        return 0;
+    } else {
+        return -1;
+    }
+}
+
 int main(int argc, char* argv[]) {
     // Input validation
     if (argc < 2) {
@@ -190,6 +454,18 @@ int main(int argc, char* argv[]) {
             return task_2();
         case 3:
             return task_3();
+        case 4:
+            return task_4();
+        case 5:
+            return task_5();
+        case 6:
+            return task_6();
+        case 7:
+            return task_7(argc - 2, argv + 2);
+        case 8:
+            return task_8(argc - 2, argv + 2);
+        case 9:
+            return task_9();
         default:
             fprintf(stderr, "Please enter a valid task, as the first argument\n");
             return -1;
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <string>
+
+#ifdef __linux__
+#include <malloc.h>
+#endif
+
+/// The heap allocations of the process, counted by the replaced global
+/// `operator new` and `operator delete` below. The replacements may only be
+/// defined once, so this header has to be included by a single translation
+/// unit.
+struct MemoryCounters {
+    /// The counters are only updated while tracking is enabled, otherwise
+    /// an allocation only costs a relaxed load. The shared counters are
+    /// contended, so tracking is never enabled during timed runs.
+    std::atomic<bool> enabled = false;
+    /// The usable bytes of the live allocations, which can become negative
+    /// if memory allocated before tracking was enabled is freed.
+    std::atomic<int64_t> live = 0;
+    /// The maximum of `live` since the last `reset_memory_peak`.
+    std::atomic<int64_t> peak = 0;
+};
+
+/// Constant initialized, so it is usable by allocations of static
+/// constructors.
+MemoryCounters MEMORY_COUNTERS;
+
+/// The allocations of the calling thread while tracking was enabled,
+/// counted per thread, so that a worker can count only the allocations of
+/// its own operations.
+thread_local uint64_t THREAD_ALLOCATIONS = 0;
+
+/// Returns the bytes actually reserved for the allocation. Without
+/// `malloc_usable_size`, only the allocations are counted.
+size_t allocation_size(void* ptr) {
+#ifdef __linux__
+    return malloc_usable_size(ptr);
+#else
+    return 0;
+#endif
+}
+
+void* operator new(size_t size) {
+    void* ptr = malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    if (MEMORY_COUNTERS.enabled.load(std::memory_order_relaxed)) {
+        int64_t bytes = allocation_size(ptr);
+        int64_t live = MEMORY_COUNTERS.live.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        THREAD_ALLOCATIONS += 1;
+        int64_t peak = MEMORY_COUNTERS.peak.load(std::memory_order_relaxed);
+        while (live > peak && !MEMORY_COUNTERS.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+        }
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    if (ptr == nullptr) {
+        return;
+    }
+    if (MEMORY_COUNTERS.enabled.load(std::memory_order_relaxed)) {
+        MEMORY_COUNTERS.live.fetch_sub(allocation_size(ptr), std::memory_order_relaxed);
+    }
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    operator delete(ptr);
+}
+
+/// The counters at a point in time.
+struct MemorySnapshot {
+    int64_t live;
+    int64_t peak;
+};
+
+MemorySnapshot memory_snapshot() {
+    return MemorySnapshot {
+        live: MEMORY_COUNTERS.live.load(std::memory_order_relaxed),
+        peak: MEMORY_COUNTERS.peak.load(std::memory_order_relaxed),
+    };
+}
+
+/// Returns the allocations of the calling thread, see `THREAD_ALLOCATIONS`.
+uint64_t thread_allocations() {
+    return THREAD_ALLOCATIONS;
+}
+
+void set_memory_tracking(bool enabled) {
+    MEMORY_COUNTERS.enabled.store(enabled);
+}
+
+/// Starts a new peak at the current live bytes.
+void reset_memory_peak() {
+    MEMORY_COUNTERS.peak.store(MEMORY_COUNTERS.live.load());
+}
+
+/// Returns the peak resident set size of the process in KiB, read from
+/// `VmHWM` of `/proc/self/status`, or -1 if it is unavailable.
+long peak_rss_kib() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("VmHWM:", 0) == 0) {
+            return std::stol(line.substr(6));
+        }
+    }
+    return -1;
+}
+
+/// Resets the peak resident set size to the current one, see `proc(5)`.
+/// Returns `false`, if the kernel doesn't allow it.
+bool reset_peak_rss() {
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+    clear_refs.flush();
+    return clear_refs.good();
+}
+
+/// The memory use of a configuration, measured in an untimed run after the
+/// timed ones. The bytes are relative to the live bytes before the data
+/// structure was created. The fields are sums, if several runs are added.
+struct MemoryTotals {
+    int runs = 0;
+    /// The bytes held after the run, before the structure was destroyed.
+    int64_t live = 0;
+    /// The highest bytes during the prefill and the run.
+    int64_t peak = 0;
+    /// The bytes still held after the structure was destroyed.
+    int64_t leaked = 0;
+    /// The allocations of the operations of the run, excluding the prefill
+    /// and the allocations of the harness.
+    uint64_t allocations = 0;
+    /// The elements stored after the run.
+    uint64_t elements = 0;
+    /// The operations of the run, set by the caller.
+    uint64_t ops = 0;
+    /// The peak resident set size of the memory run in KiB, or -1.
+    long peak_rss_kib = -1;
+};
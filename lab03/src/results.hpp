@@ -0,0 +1,220 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef COMPILE_FLAGS
+/// The flags the binary was compiled with, set by the makefile.
+#define COMPILE_FLAGS "unknown"
+#endif
+
+#ifdef __clang__
+#define COMPILER_VERSION __VERSION__
+#else
+#define COMPILER_VERSION "g++ " __VERSION__
+#endif
+
+/// The results file, if the `BENCH_RESULTS` environment variable isn't set.
+#define DEFAULT_RESULTS_FILE "bench_results.csv"
+
+namespace bench {
+
+    /// The columns, which identify a configuration in a results file.
+    const char* RESULT_CONFIG_COLUMNS[] = {
+        "structure", "distribution", "keys", "ctn", "add", "rmv", "threads", "ops", "duration", "prefill", "seed", "placement",
+    };
+    /// The columns following the configuration. The throughput is in
+    /// ops/ms, `cpus` lists the CPUs the threads were pinned to.
+    const char* RESULT_METRIC_COLUMNS[] = {"runs", "median", "mean", "stddev", "ci95", "cpus"};
+
+    /// Returns the CPU model from `/proc/cpuinfo`.
+    std::string cpu_model() {
+        std::ifstream cpuinfo("/proc/cpuinfo");
+        std::string line;
+        while (std::getline(cpuinfo, line)) {
+            if (line.rfind("model name", 0) == 0) {
+                size_t separator = line.find(':');
+                if (separator != std::string::npos && separator + 2 <= line.size()) {
+                    return line.substr(separator + 2);
+                }
+            }
+        }
+        return "unknown";
+    }
+
+    /// Writes benchmark results as CSV, one row per configuration with the
+    /// columns above. The file starts with comment lines, which describe
+    /// the environment.
+    class ResultWriter {
+    public:
+        ResultWriter(const char* path) {
+            this->file = fopen(path, "w");
+            if (this->file == nullptr) {
+                fprintf(stderr, "Failed to open the results file `%s`\n", path);
+                return;
+            }
+
+            fprintf(this->file, "# cpu: %s\n", cpu_model().c_str());
+            fprintf(this->file, "# cores: %u\n", std::thread::hardware_concurrency());
+            fprintf(this->file, "# compiler: %s\n", COMPILER_VERSION);
+            fprintf(this->file, "# flags: %s\n", COMPILE_FLAGS);
+            for (const char* column : RESULT_CONFIG_COLUMNS) {
+                fprintf(this->file, "%s,", column);
+            }
+            for (const char* column : RESULT_METRIC_COLUMNS) {
+                fprintf(this->file, "%s", column);
+                fprintf(this->file, column == std::end(RESULT_METRIC_COLUMNS)[-1] ? "\n" : ",");
+            }
+        }
+
+        ~ResultWriter() {
+            if (this->file) {
+                fclose(this->file);
+            }
+        }
+
+        void append(const char* row) {
+            if (this->file == nullptr) {
+                return;
+            }
+            fprintf(this->file, "%s\n", row);
+            // Keep the results of aborted runs
+            fflush(this->file);
+        }
+
+    private:
+        FILE* file = nullptr;
+    };
+
+    /// The throughput statistics of a configuration read from a results file.
+    struct ResultRow {
+        std::string config;
+        int runs;
+        double median;
+        double mean;
+        double ci;
+    };
+
+    /// Reads a results file written by `ResultWriter`. The configuration
+    /// columns are joined into a single key. Returns `false` on errors.
+    bool read_results(const char* path, std::vector<ResultRow>* rows) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            fprintf(stderr, "Failed to open the results file `%s`\n", path);
+            return false;
+        }
+
+        const int config_columns = std::size(RESULT_CONFIG_COLUMNS);
+        std::string line;
+        bool is_header = true;
+        while (std::getline(file, line)) {
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            if (is_header) {
+                is_header = false;
+                continue;
+            }
+
+            std::vector<std::string> cells;
+            size_t start = 0;
+            while (start <= line.size()) {
+                size_t end = std::min(line.find(',', start), line.size());
+                cells.push_back(line.substr(start, end - start));
+                start = end + 1;
+            }
+            if ((int)cells.size() != config_columns + (int)std::size(RESULT_METRIC_COLUMNS)) {
+                fprintf(stderr, "The results file `%s` has an unexpected row: %s\n", path, line.c_str());
+                return false;
+            }
+
+            ResultRow row;
+            for (int i = 0; i < config_columns; i++) {
+                row.config += (i == 0 ? "" : ",") + cells[i];
+            }
+            try {
+                row.runs = std::stoi(cells[config_columns]);
+                row.median = std::stod(cells[config_columns + 1]);
+                row.mean = std::stod(cells[config_columns + 2]);
+                row.ci = std::stod(cells[config_columns + 4]);
+            }
+            catch (const std::logic_error& error) {
+                fprintf(stderr, "The results file `%s` has an invalid row: %s\n", path, line.c_str());
+                return false;
+            }
+            rows->push_back(row);
+        }
+        return true;
+    }
+
+    /// Compares the configurations found in both results files. A change is
+    /// significant, if the 95% confidence intervals of the means don't
+    /// overlap. Returns the number of significant regressions, where the
+    /// median throughput dropped by more than `threshold` percent, or -1 if
+    /// a file couldn't be read.
+    int compare_results(const char* old_path, const char* new_path, double threshold) {
+        std::vector<ResultRow> old_rows;
+        std::vector<ResultRow> new_rows;
+        if (!read_results(old_path, &old_rows) || !read_results(new_path, &new_rows)) {
+            return -1;
+        }
+
+        std::map<std::string, ResultRow*> old_configs;
+        for (ResultRow& row : old_rows) {
+            old_configs[row.config] = &row;
+        }
+
+        for (const char* column : RESULT_CONFIG_COLUMNS) {
+            printf("%s,", column);
+        }
+        printf(" old [ops/ms], new [ops/ms], change, significant, verdict\n");
+        int regressions = 0;
+        int matched = 0;
+        for (ResultRow& row : new_rows) {
+            auto it = old_configs.find(row.config);
+            if (it == old_configs.end()) {
+                continue;
+            }
+            ResultRow* old_row = it->second;
+            matched += 1;
+
+            double change = (row.median / old_row->median - 1.0) * 100.0;
+            bool significant = std::abs(row.mean - old_row->mean) > row.ci + old_row->ci;
+            char const* verdict = "";
+            if (significant && change < -threshold) {
+                verdict = "regression";
+                regressions += 1;
+            } else if (significant && change > threshold) {
+                verdict = "speedup";
+            }
+            printf(
+                "%s, %12.1f, %12.1f, %+5.1f%%, %11s, %s\n",
+                row.config.c_str(),
+                old_row->median,
+                row.median,
+                change,
+                significant ? "yes" : "no",
+                verdict
+            );
+        }
+
+        printf(
+            "Compared %d configurations (%zu old, %zu new), %d regressed by more than %.1f%%\n",
+            matched,
+            old_rows.size(),
+            new_rows.size(),
+            regressions,
+            threshold
+        );
+        return regressions;
+    }
+}
@@ -2,12 +2,14 @@
 
 #include "adt.hpp"
 
-#include <stack>
+#include <vector>
 
+/// The sequential reference stack. The elements are stored in a vector,
+/// with the top of the stack at the end.
 class StdStack: public Stack {
    public:
     int push(int value) override {
-        state.push(value);
+        state.push_back(value);
         return true;
     }
 
@@ -15,8 +17,8 @@ class StdStack: public Stack {
         if (state.empty()) {
             return EMPTY_STACK_VALUE;
         }
-        int value = state.top();
-        state.pop();
+        int value = state.back();
+        state.pop_back();
         return value;
     }
 
@@ -24,22 +26,24 @@ class StdStack: public Stack {
         return state.size();
     }
 
+    bool operator==(const StdStack& other) const {
+        return this->state == other.state;
+    }
+
     void print_state() override {
         std::cout << "{";
         bool first = true;
-        int top = this->pop();
-        while (top != EMPTY_STACK_VALUE) {
+        for (auto it = this->state.rbegin(); it != this->state.rend(); it++) {
             if (first) {
                 first = false;
             } else {
                 std::cout << ", ";
             }
-            std::cout << top;
-            top = this->pop();
+            std::cout << *it;
         }
         std::cout << "}";
     }
 
    private:
-    std::stack<int> state;
-};
\ No newline at end of file
+    std::vector<int> state;
+};
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "adt.hpp"
+#include "epoch.hpp"
+#include "instrument.hpp"
 
 struct TreiberStackNode {
   int value;
@@ -9,15 +11,42 @@ struct TreiberStackNode {
   TreiberStackNode(int val = 0) : value(val), next(nullptr) {}
 };
 
+/// A lock-free stack. With a validating monitor, the CAS operations are
+/// guarded by `cas_lock` to insert the events at the linearization point.
+/// Without a monitor the lock is skipped. Popped nodes are then retired with
+/// the epoch-based reclamation of `epoch.hpp`, since other threads might
+/// still read them. `pop` and `size` pin the calling thread for this, which
+/// also rules out ABA on `top`, as no node is reused while it's pinned.
+template <typename Monitor = NullMonitor<StackOperator>>
 class TreiberStack : public Stack {
 private:
   std::atomic<TreiberStackNode *> top{nullptr}; // Initialize to nullptr
-  EventMonitor<TreiberStack, StdStack, StackOperator> *monitor;
+  Monitor *monitor;
   std::mutex cas_lock;
 
+  void lock_linearization() {
+    if constexpr (Monitor::enabled) {
+      cas_lock.lock();
+    }
+  }
+
+  void unlock_linearization() {
+    if constexpr (Monitor::enabled) {
+      cas_lock.unlock();
+    }
+  }
+
+  /// Frees a popped node, or retires it if other threads might still read it.
+  void release(TreiberStackNode *node) {
+    if constexpr (Monitor::enabled) {
+      delete node;
+    } else {
+      epoch_retire(node);
+    }
+  }
+
 public:
-  TreiberStack(EventMonitor<TreiberStack, StdStack, StackOperator> *monitor)
-      : monitor(monitor) {}
+  TreiberStack(Monitor *monitor = Monitor::instance()) : monitor(monitor) {}
 
   ~TreiberStack() {
     TreiberStackNode *current = top.load();
@@ -30,21 +59,24 @@ public:
 
   int push(int value) override {
     int result = true;
+    PHASE_BEGIN();
     TreiberStackNode *n = new TreiberStackNode(value);
+    PHASE_MARK(PhaseAllocation);
 
     while (true) {
       TreiberStackNode *t = top.load();
       n->next = t;
 
-      cas_lock.lock();
+      lock_linearization();
       if (top.compare_exchange_strong(t, n)) { // Use atomic CAS
         monitor->add(StackEvent(StackOperator::StackPush, value, result));
-        cas_lock.unlock();
+        unlock_linearization();
         break;
       }
-      cas_lock.unlock();
-      // Retry
+      unlock_linearization();
+      INSTRUMENT_COUNT(ContentionCasFailures);
     }
+    PHASE_MARK(PhaseLinearization);
 
     return result;
   }
@@ -52,41 +84,54 @@ public:
   int pop() override {
     int result = EMPTY_STACK_VALUE;
 
+    PHASE_BEGIN();
+    EpochGuard guard;
+    PHASE_MARK(PhaseReclamation);
     while (true) {
-      cas_lock.lock();
+      lock_linearization();
       TreiberStackNode *t = top.load();
 
       if (t == nullptr) {
         monitor->add(
             StackEvent(StackOperator::StackPop, NO_ARGUMENT_VALUE, result));
-        cas_lock.unlock();
+        unlock_linearization();
+        PHASE_MARK(PhaseLinearization);
         return result;
       }
 
       if (top.compare_exchange_strong(t, t->next)) { // Use atomic CAS
         result = t->value;
-        delete t;
+        PHASE_MARK(PhaseLinearization);
+        release(t);
+        PHASE_MARK(PhaseReclamation);
         monitor->add(
             StackEvent(StackOperator::StackPop, NO_ARGUMENT_VALUE, result));
-        cas_lock.unlock();
+        unlock_linearization();
+        PHASE_MARK(PhaseLinearization);
         return result;
       }
-      cas_lock.unlock();
+      unlock_linearization();
+      INSTRUMENT_COUNT(ContentionCasFailures);
     }
   }
 
   int size() override {
     int result = 0;
 
-    cas_lock.lock();
+    PHASE_BEGIN();
+    EpochGuard guard;
+    PHASE_MARK(PhaseReclamation);
+    lock_linearization();
     TreiberStackNode *t = top.load();
     while (t != nullptr) {
       result++;
       t = t->next;
     }
+    PHASE_MARK(PhaseTraversal);
     monitor->add(
         StackEvent(StackOperator::StackSize, NO_ARGUMENT_VALUE, result));
-    cas_lock.unlock();
+    unlock_linearization();
+    PHASE_MARK(PhaseLinearization);
 
     return result;
   }
@@ -0,0 +1,12 @@
+# Latency under increasing offered load. The achieved rate falls behind
+# the offered rate once a structure saturates.
+name = open-loop
+keys = 1024
+prefill = 0.5
+ctn = 90
+add = 5
+rmv = 5
+threads = 4
+ops = 1000
+arrival = poisson
+rates = 100, 500, 1000, 2000, 5000
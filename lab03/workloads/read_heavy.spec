@@ -0,0 +1,11 @@
+# Mostly lookups on a small, prefilled key range.
+name = read-heavy
+keys = 1024
+prefill = 0.5
+ctn = 90
+add = 5
+rmv = 5
+distribution = uniform
+threads = 1, 2, 4, 8, 16
+ops = 2000
+latencies = yes
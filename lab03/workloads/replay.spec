@@ -0,0 +1,4 @@
+# Replays the trace recorded by task 5 with the original timing.
+name = replay
+trace = stack.trace
+replay = timed
@@ -0,0 +1,11 @@
+# Timed runs on a structure prefilled to the steady state of the mix.
+name = steady-state
+keys = 1024
+prefill = steady
+ctn = 80
+add = 10
+rmv = 10
+distribution = uniform
+threads = 1, 2, 4, 8, 16
+duration = 100
+repetitions = 3